@@ -3,306 +3,7160 @@
 #include <string>
 #include <queue>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <algorithm>
 #include <cassert>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <limits>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <condition_variable>
+#include <numeric>
+#include <deque>
+#ifdef AHO_CORASICK_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef AHO_CORASICK_WITH_ZSTD
+#include <zstd.h>
+#endif
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define AHO_CORASICK_HAVE_IO_URING 1
+#endif
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
+/**
+ * @brief Runs body(i) for every i in [0, n) on up to numThreads threads.
+ *
+ * Work is handed out in chunks of chunkSize items from a shared counter so
+ * uneven items do not leave threads idle. Ranges no larger than one chunk run
+ * inline on the calling thread.
+ */
+template <typename Body>
+void parallelFor(size_t n, unsigned numThreads, const Body& body, size_t chunkSize = 64) {
+    if (numThreads <= 1 || n <= chunkSize) {
+        for (size_t i = 0; i < n; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    atomic<size_t> next{0};
+    auto worker = [&]() {
+        while (true) {
+            size_t begin = next.fetch_add(chunkSize);
+            if (begin >= n) {
+                return;
+            }
+            size_t end = min(n, begin + chunkSize);
+            for (size_t i = begin; i < end; ++i) {
+                body(i);
+            }
+        }
+    };
+
+    size_t threadCount = min<size_t>(numThreads, (n + chunkSize - 1) / chunkSize);
+    vector<thread> threads;
+    for (size_t t = 1; t < threadCount; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+// UTF-8 helpers used by the Unicode case folding modes.
+
+/**
+ * @brief Decodes the UTF-8 sequence starting at s[0].
+ *
+ * @return The number of bytes consumed, or 0 if the bytes do not start a
+ *         well-formed sequence (the caller then treats s[0] as a raw byte).
+ */
+inline size_t decodeUtf8(const char* s, size_t n, char32_t& cp) {
+    unsigned char b0 = s[0];
+    size_t length;
+    char32_t minimum;
+    if (b0 < 0x80) {
+        cp = b0;
+        return 1;
+    } else if ((b0 & 0xE0) == 0xC0) {
+        length = 2; cp = b0 & 0x1F; minimum = 0x80;
+    } else if ((b0 & 0xF0) == 0xE0) {
+        length = 3; cp = b0 & 0x0F; minimum = 0x800;
+    } else if ((b0 & 0xF8) == 0xF0) {
+        length = 4; cp = b0 & 0x07; minimum = 0x10000;
+    } else {
+        return 0;
+    }
+    if (length > n) {
+        return 0;
+    }
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char b = s[k];
+        if ((b & 0xC0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (b & 0x3F);
+    }
+    if (cp < minimum || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return 0;
+    }
+    return length;
+}
+
+// Whether s[0..n) is an incomplete prefix of a sequence decodeUtf8() accepts:
+// the lead byte and the range of the second byte rule out overlong forms,
+// surrogates and code points past U+10FFFF, as the decoder does.
+inline bool isTruncatedUtf8(const char* s, size_t n) {
+    unsigned char b0 = s[0];
+    size_t length = b0 >= 0xC2 && b0 <= 0xDF ? 2 : (b0 & 0xF0) == 0xE0 ? 3 : b0 >= 0xF0 && b0 <= 0xF4 ? 4 : 0;
+    if (length == 0 || n >= length) {
+        return false;
+    }
+    if (n > 1) {
+        unsigned char b1 = s[1];
+        unsigned char low = b0 == 0xE0 ? 0xA0 : b0 == 0xF0 ? 0x90 : 0x80;
+        unsigned char high = b0 == 0xED ? 0x9F : b0 == 0xF4 ? 0x8F : 0xBF;
+        if (b1 < low || b1 > high) {
+            return false;
+        }
+    }
+    for (size_t k = 2; k < n; ++k) {
+        if ((static_cast<unsigned char>(s[k]) & 0xC0) != 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Appends the UTF-8 encoding of cp to out.
+inline void encodeUtf8(char32_t cp, string& out) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Case folding and decomposition tables, generated from the Unicode 14.0
+// character database (CaseFolding.txt statuses C and F, UnicodeData.txt).
+
+// Code points first, first + stride, ... up to last fold to cp + delta.
+struct FoldRun {
+    char32_t first;
+    char32_t last;
+    int32_t delta;
+    uint8_t stride;
+};
+
+const FoldRun kFoldRuns[] = {
+    {0x0041, 0x005A, 32, 1}, {0x00B5, 0x00B5, 775, 1}, {0x00C0, 0x00D6, 32, 1},
+    {0x00D8, 0x00DE, 32, 1}, {0x0100, 0x012E, 1, 2}, {0x0132, 0x0136, 1, 2},
+    {0x0139, 0x0147, 1, 2}, {0x014A, 0x0176, 1, 2}, {0x0178, 0x0178, -121, 1},
+    {0x0179, 0x017D, 1, 2}, {0x017F, 0x017F, -268, 1}, {0x0181, 0x0181, 210, 1},
+    {0x0182, 0x0184, 1, 2}, {0x0186, 0x0186, 206, 1}, {0x0187, 0x0187, 1, 1},
+    {0x0189, 0x018A, 205, 1}, {0x018B, 0x018B, 1, 1}, {0x018E, 0x018E, 79, 1},
+    {0x018F, 0x018F, 202, 1}, {0x0190, 0x0190, 203, 1}, {0x0191, 0x0191, 1, 1},
+    {0x0193, 0x0193, 205, 1}, {0x0194, 0x0194, 207, 1}, {0x0196, 0x0196, 211, 1},
+    {0x0197, 0x0197, 209, 1}, {0x0198, 0x0198, 1, 1}, {0x019C, 0x019C, 211, 1},
+    {0x019D, 0x019D, 213, 1}, {0x019F, 0x019F, 214, 1}, {0x01A0, 0x01A4, 1, 2},
+    {0x01A6, 0x01A6, 218, 1}, {0x01A7, 0x01A7, 1, 1}, {0x01A9, 0x01A9, 218, 1},
+    {0x01AC, 0x01AC, 1, 1}, {0x01AE, 0x01AE, 218, 1}, {0x01AF, 0x01AF, 1, 1},
+    {0x01B1, 0x01B2, 217, 1}, {0x01B3, 0x01B5, 1, 2}, {0x01B7, 0x01B7, 219, 1},
+    {0x01B8, 0x01B8, 1, 1}, {0x01BC, 0x01BC, 1, 1}, {0x01C4, 0x01C4, 2, 1},
+    {0x01C5, 0x01C5, 1, 1}, {0x01C7, 0x01C7, 2, 1}, {0x01C8, 0x01C8, 1, 1},
+    {0x01CA, 0x01CA, 2, 1}, {0x01CB, 0x01DB, 1, 2}, {0x01DE, 0x01EE, 1, 2},
+    {0x01F1, 0x01F1, 2, 1}, {0x01F2, 0x01F4, 1, 2}, {0x01F6, 0x01F6, -97, 1},
+    {0x01F7, 0x01F7, -56, 1}, {0x01F8, 0x021E, 1, 2}, {0x0220, 0x0220, -130, 1},
+    {0x0222, 0x0232, 1, 2}, {0x023A, 0x023A, 10795, 1}, {0x023B, 0x023B, 1, 1},
+    {0x023D, 0x023D, -163, 1}, {0x023E, 0x023E, 10792, 1}, {0x0241, 0x0241, 1, 1},
+    {0x0243, 0x0243, -195, 1}, {0x0244, 0x0244, 69, 1}, {0x0245, 0x0245, 71, 1},
+    {0x0246, 0x024E, 1, 2}, {0x0345, 0x0345, 116, 1}, {0x0370, 0x0372, 1, 2},
+    {0x0376, 0x0376, 1, 1}, {0x037F, 0x037F, 116, 1}, {0x0386, 0x0386, 38, 1},
+    {0x0388, 0x038A, 37, 1}, {0x038C, 0x038C, 64, 1}, {0x038E, 0x038F, 63, 1},
+    {0x0391, 0x03A1, 32, 1}, {0x03A3, 0x03AB, 32, 1}, {0x03C2, 0x03C2, 1, 1},
+    {0x03CF, 0x03CF, 8, 1}, {0x03D0, 0x03D0, -30, 1}, {0x03D1, 0x03D1, -25, 1},
+    {0x03D5, 0x03D5, -15, 1}, {0x03D6, 0x03D6, -22, 1}, {0x03D8, 0x03EE, 1, 2},
+    {0x03F0, 0x03F0, -54, 1}, {0x03F1, 0x03F1, -48, 1}, {0x03F4, 0x03F4, -60, 1},
+    {0x03F5, 0x03F5, -64, 1}, {0x03F7, 0x03F7, 1, 1}, {0x03F9, 0x03F9, -7, 1},
+    {0x03FA, 0x03FA, 1, 1}, {0x03FD, 0x03FF, -130, 1}, {0x0400, 0x040F, 80, 1},
+    {0x0410, 0x042F, 32, 1}, {0x0460, 0x0480, 1, 2}, {0x048A, 0x04BE, 1, 2},
+    {0x04C0, 0x04C0, 15, 1}, {0x04C1, 0x04CD, 1, 2}, {0x04D0, 0x052E, 1, 2},
+    {0x0531, 0x0556, 48, 1}, {0x10A0, 0x10C5, 7264, 1}, {0x10C7, 0x10C7, 7264, 1},
+    {0x10CD, 0x10CD, 7264, 1}, {0x13F8, 0x13FD, -8, 1}, {0x1C80, 0x1C80, -6222, 1},
+    {0x1C81, 0x1C81, -6221, 1}, {0x1C82, 0x1C82, -6212, 1}, {0x1C83, 0x1C84, -6210, 1},
+    {0x1C85, 0x1C85, -6211, 1}, {0x1C86, 0x1C86, -6204, 1}, {0x1C87, 0x1C87, -6180, 1},
+    {0x1C88, 0x1C88, 35267, 1}, {0x1C90, 0x1CBA, -3008, 1}, {0x1CBD, 0x1CBF, -3008, 1},
+    {0x1E00, 0x1E94, 1, 2}, {0x1E9B, 0x1E9B, -58, 1}, {0x1EA0, 0x1EFE, 1, 2},
+    {0x1F08, 0x1F0F, -8, 1}, {0x1F18, 0x1F1D, -8, 1}, {0x1F28, 0x1F2F, -8, 1},
+    {0x1F38, 0x1F3F, -8, 1}, {0x1F48, 0x1F4D, -8, 1}, {0x1F59, 0x1F5F, -8, 2},
+    {0x1F68, 0x1F6F, -8, 1}, {0x1FB8, 0x1FB9, -8, 1}, {0x1FBA, 0x1FBB, -74, 1},
+    {0x1FBE, 0x1FBE, -7173, 1}, {0x1FC8, 0x1FCB, -86, 1}, {0x1FD8, 0x1FD9, -8, 1},
+    {0x1FDA, 0x1FDB, -100, 1}, {0x1FE8, 0x1FE9, -8, 1}, {0x1FEA, 0x1FEB, -112, 1},
+    {0x1FEC, 0x1FEC, -7, 1}, {0x1FF8, 0x1FF9, -128, 1}, {0x1FFA, 0x1FFB, -126, 1},
+    {0x2126, 0x2126, -7517, 1}, {0x212A, 0x212A, -8383, 1}, {0x212B, 0x212B, -8262, 1},
+    {0x2132, 0x2132, 28, 1}, {0x2160, 0x216F, 16, 1}, {0x2183, 0x2183, 1, 1},
+    {0x24B6, 0x24CF, 26, 1}, {0x2C00, 0x2C2F, 48, 1}, {0x2C60, 0x2C60, 1, 1},
+    {0x2C62, 0x2C62, -10743, 1}, {0x2C63, 0x2C63, -3814, 1}, {0x2C64, 0x2C64, -10727, 1},
+    {0x2C67, 0x2C6B, 1, 2}, {0x2C6D, 0x2C6D, -10780, 1}, {0x2C6E, 0x2C6E, -10749, 1},
+    {0x2C6F, 0x2C6F, -10783, 1}, {0x2C70, 0x2C70, -10782, 1}, {0x2C72, 0x2C72, 1, 1},
+    {0x2C75, 0x2C75, 1, 1}, {0x2C7E, 0x2C7F, -10815, 1}, {0x2C80, 0x2CE2, 1, 2},
+    {0x2CEB, 0x2CED, 1, 2}, {0x2CF2, 0x2CF2, 1, 1}, {0xA640, 0xA66C, 1, 2},
+    {0xA680, 0xA69A, 1, 2}, {0xA722, 0xA72E, 1, 2}, {0xA732, 0xA76E, 1, 2},
+    {0xA779, 0xA77B, 1, 2}, {0xA77D, 0xA77D, -35332, 1}, {0xA77E, 0xA786, 1, 2},
+    {0xA78B, 0xA78B, 1, 1}, {0xA78D, 0xA78D, -42280, 1}, {0xA790, 0xA792, 1, 2},
+    {0xA796, 0xA7A8, 1, 2}, {0xA7AA, 0xA7AA, -42308, 1}, {0xA7AB, 0xA7AB, -42319, 1},
+    {0xA7AC, 0xA7AC, -42315, 1}, {0xA7AD, 0xA7AD, -42305, 1}, {0xA7AE, 0xA7AE, -42308, 1},
+    {0xA7B0, 0xA7B0, -42258, 1}, {0xA7B1, 0xA7B1, -42282, 1}, {0xA7B2, 0xA7B2, -42261, 1},
+    {0xA7B3, 0xA7B3, 928, 1}, {0xA7B4, 0xA7C2, 1, 2}, {0xA7C4, 0xA7C4, -48, 1},
+    {0xA7C5, 0xA7C5, -42307, 1}, {0xA7C6, 0xA7C6, -35384, 1}, {0xA7C7, 0xA7C9, 1, 2},
+    {0xA7D0, 0xA7D0, 1, 1}, {0xA7D6, 0xA7D8, 1, 2}, {0xA7F5, 0xA7F5, 1, 1},
+    {0xAB70, 0xABBF, -38864, 1}, {0xFF21, 0xFF3A, 32, 1}, {0x10400, 0x10427, 40, 1},
+    {0x104B0, 0x104D3, 40, 1}, {0x10570, 0x1057A, 39, 1}, {0x1057C, 0x1058A, 39, 1},
+    {0x1058C, 0x10592, 39, 1}, {0x10594, 0x10595, 39, 1}, {0x10C80, 0x10CB2, 64, 1},
+    {0x118A0, 0x118BF, 32, 1}, {0x16E40, 0x16E5F, 32, 1}, {0x1E900, 0x1E921, 34, 1},
+};
+
+// Code points whose full case folding has several code points (unused ones are 0).
+struct FoldExpansion {
+    char32_t cp;
+    char32_t folded[3];
+};
+
+const FoldExpansion kFoldExpansions[] = {
+    {0x00DF, {0x0073, 0x0073}}, {0x0130, {0x0069, 0x0307}},
+    {0x0149, {0x02BC, 0x006E}}, {0x01F0, {0x006A, 0x030C}},
+    {0x0390, {0x03B9, 0x0308, 0x0301}}, {0x03B0, {0x03C5, 0x0308, 0x0301}},
+    {0x0587, {0x0565, 0x0582}}, {0x1E96, {0x0068, 0x0331}},
+    {0x1E97, {0x0074, 0x0308}}, {0x1E98, {0x0077, 0x030A}},
+    {0x1E99, {0x0079, 0x030A}}, {0x1E9A, {0x0061, 0x02BE}},
+    {0x1E9E, {0x0073, 0x0073}}, {0x1F50, {0x03C5, 0x0313}},
+    {0x1F52, {0x03C5, 0x0313, 0x0300}}, {0x1F54, {0x03C5, 0x0313, 0x0301}},
+    {0x1F56, {0x03C5, 0x0313, 0x0342}}, {0x1F80, {0x1F00, 0x03B9}},
+    {0x1F81, {0x1F01, 0x03B9}}, {0x1F82, {0x1F02, 0x03B9}},
+    {0x1F83, {0x1F03, 0x03B9}}, {0x1F84, {0x1F04, 0x03B9}},
+    {0x1F85, {0x1F05, 0x03B9}}, {0x1F86, {0x1F06, 0x03B9}},
+    {0x1F87, {0x1F07, 0x03B9}}, {0x1F88, {0x1F00, 0x03B9}},
+    {0x1F89, {0x1F01, 0x03B9}}, {0x1F8A, {0x1F02, 0x03B9}},
+    {0x1F8B, {0x1F03, 0x03B9}}, {0x1F8C, {0x1F04, 0x03B9}},
+    {0x1F8D, {0x1F05, 0x03B9}}, {0x1F8E, {0x1F06, 0x03B9}},
+    {0x1F8F, {0x1F07, 0x03B9}}, {0x1F90, {0x1F20, 0x03B9}},
+    {0x1F91, {0x1F21, 0x03B9}}, {0x1F92, {0x1F22, 0x03B9}},
+    {0x1F93, {0x1F23, 0x03B9}}, {0x1F94, {0x1F24, 0x03B9}},
+    {0x1F95, {0x1F25, 0x03B9}}, {0x1F96, {0x1F26, 0x03B9}},
+    {0x1F97, {0x1F27, 0x03B9}}, {0x1F98, {0x1F20, 0x03B9}},
+    {0x1F99, {0x1F21, 0x03B9}}, {0x1F9A, {0x1F22, 0x03B9}},
+    {0x1F9B, {0x1F23, 0x03B9}}, {0x1F9C, {0x1F24, 0x03B9}},
+    {0x1F9D, {0x1F25, 0x03B9}}, {0x1F9E, {0x1F26, 0x03B9}},
+    {0x1F9F, {0x1F27, 0x03B9}}, {0x1FA0, {0x1F60, 0x03B9}},
+    {0x1FA1, {0x1F61, 0x03B9}}, {0x1FA2, {0x1F62, 0x03B9}},
+    {0x1FA3, {0x1F63, 0x03B9}}, {0x1FA4, {0x1F64, 0x03B9}},
+    {0x1FA5, {0x1F65, 0x03B9}}, {0x1FA6, {0x1F66, 0x03B9}},
+    {0x1FA7, {0x1F67, 0x03B9}}, {0x1FA8, {0x1F60, 0x03B9}},
+    {0x1FA9, {0x1F61, 0x03B9}}, {0x1FAA, {0x1F62, 0x03B9}},
+    {0x1FAB, {0x1F63, 0x03B9}}, {0x1FAC, {0x1F64, 0x03B9}},
+    {0x1FAD, {0x1F65, 0x03B9}}, {0x1FAE, {0x1F66, 0x03B9}},
+    {0x1FAF, {0x1F67, 0x03B9}}, {0x1FB2, {0x1F70, 0x03B9}},
+    {0x1FB3, {0x03B1, 0x03B9}}, {0x1FB4, {0x03AC, 0x03B9}},
+    {0x1FB6, {0x03B1, 0x0342}}, {0x1FB7, {0x03B1, 0x0342, 0x03B9}},
+    {0x1FBC, {0x03B1, 0x03B9}}, {0x1FC2, {0x1F74, 0x03B9}},
+    {0x1FC3, {0x03B7, 0x03B9}}, {0x1FC4, {0x03AE, 0x03B9}},
+    {0x1FC6, {0x03B7, 0x0342}}, {0x1FC7, {0x03B7, 0x0342, 0x03B9}},
+    {0x1FCC, {0x03B7, 0x03B9}}, {0x1FD2, {0x03B9, 0x0308, 0x0300}},
+    {0x1FD3, {0x03B9, 0x0308, 0x0301}}, {0x1FD6, {0x03B9, 0x0342}},
+    {0x1FD7, {0x03B9, 0x0308, 0x0342}}, {0x1FE2, {0x03C5, 0x0308, 0x0300}},
+    {0x1FE3, {0x03C5, 0x0308, 0x0301}}, {0x1FE4, {0x03C1, 0x0313}},
+    {0x1FE6, {0x03C5, 0x0342}}, {0x1FE7, {0x03C5, 0x0308, 0x0342}},
+    {0x1FF2, {0x1F7C, 0x03B9}}, {0x1FF3, {0x03C9, 0x03B9}},
+    {0x1FF4, {0x03CE, 0x03B9}}, {0x1FF6, {0x03C9, 0x0342}},
+    {0x1FF7, {0x03C9, 0x0342, 0x03B9}}, {0x1FFC, {0x03C9, 0x03B9}},
+    {0xFB00, {0x0066, 0x0066}}, {0xFB01, {0x0066, 0x0069}},
+    {0xFB02, {0x0066, 0x006C}}, {0xFB03, {0x0066, 0x0066, 0x0069}},
+    {0xFB04, {0x0066, 0x0066, 0x006C}}, {0xFB05, {0x0073, 0x0074}},
+    {0xFB06, {0x0073, 0x0074}}, {0xFB13, {0x0574, 0x0576}},
+    {0xFB14, {0x0574, 0x0565}}, {0xFB15, {0x0574, 0x056B}},
+    {0xFB16, {0x057E, 0x0576}}, {0xFB17, {0x0574, 0x056D}},
+};
+
+// Canonical decompositions, one level deep: cp -> first, second (0 if none).
+// The CJK compatibility ideographs are left out.
+struct Decomposition {
+    char32_t cp;
+    char32_t first;
+    char32_t second;
+};
+
+const Decomposition kDecompositions[] = {
+    {0x00C0, 0x0041, 0x0300}, {0x00C1, 0x0041, 0x0301}, {0x00C2, 0x0041, 0x0302}, {0x00C3, 0x0041, 0x0303},
+    {0x00C4, 0x0041, 0x0308}, {0x00C5, 0x0041, 0x030A}, {0x00C7, 0x0043, 0x0327}, {0x00C8, 0x0045, 0x0300},
+    {0x00C9, 0x0045, 0x0301}, {0x00CA, 0x0045, 0x0302}, {0x00CB, 0x0045, 0x0308}, {0x00CC, 0x0049, 0x0300},
+    {0x00CD, 0x0049, 0x0301}, {0x00CE, 0x0049, 0x0302}, {0x00CF, 0x0049, 0x0308}, {0x00D1, 0x004E, 0x0303},
+    {0x00D2, 0x004F, 0x0300}, {0x00D3, 0x004F, 0x0301}, {0x00D4, 0x004F, 0x0302}, {0x00D5, 0x004F, 0x0303},
+    {0x00D6, 0x004F, 0x0308}, {0x00D9, 0x0055, 0x0300}, {0x00DA, 0x0055, 0x0301}, {0x00DB, 0x0055, 0x0302},
+    {0x00DC, 0x0055, 0x0308}, {0x00DD, 0x0059, 0x0301}, {0x00E0, 0x0061, 0x0300}, {0x00E1, 0x0061, 0x0301},
+    {0x00E2, 0x0061, 0x0302}, {0x00E3, 0x0061, 0x0303}, {0x00E4, 0x0061, 0x0308}, {0x00E5, 0x0061, 0x030A},
+    {0x00E7, 0x0063, 0x0327}, {0x00E8, 0x0065, 0x0300}, {0x00E9, 0x0065, 0x0301}, {0x00EA, 0x0065, 0x0302},
+    {0x00EB, 0x0065, 0x0308}, {0x00EC, 0x0069, 0x0300}, {0x00ED, 0x0069, 0x0301}, {0x00EE, 0x0069, 0x0302},
+    {0x00EF, 0x0069, 0x0308}, {0x00F1, 0x006E, 0x0303}, {0x00F2, 0x006F, 0x0300}, {0x00F3, 0x006F, 0x0301},
+    {0x00F4, 0x006F, 0x0302}, {0x00F5, 0x006F, 0x0303}, {0x00F6, 0x006F, 0x0308}, {0x00F9, 0x0075, 0x0300},
+    {0x00FA, 0x0075, 0x0301}, {0x00FB, 0x0075, 0x0302}, {0x00FC, 0x0075, 0x0308}, {0x00FD, 0x0079, 0x0301},
+    {0x00FF, 0x0079, 0x0308}, {0x0100, 0x0041, 0x0304}, {0x0101, 0x0061, 0x0304}, {0x0102, 0x0041, 0x0306},
+    {0x0103, 0x0061, 0x0306}, {0x0104, 0x0041, 0x0328}, {0x0105, 0x0061, 0x0328}, {0x0106, 0x0043, 0x0301},
+    {0x0107, 0x0063, 0x0301}, {0x0108, 0x0043, 0x0302}, {0x0109, 0x0063, 0x0302}, {0x010A, 0x0043, 0x0307},
+    {0x010B, 0x0063, 0x0307}, {0x010C, 0x0043, 0x030C}, {0x010D, 0x0063, 0x030C}, {0x010E, 0x0044, 0x030C},
+    {0x010F, 0x0064, 0x030C}, {0x0112, 0x0045, 0x0304}, {0x0113, 0x0065, 0x0304}, {0x0114, 0x0045, 0x0306},
+    {0x0115, 0x0065, 0x0306}, {0x0116, 0x0045, 0x0307}, {0x0117, 0x0065, 0x0307}, {0x0118, 0x0045, 0x0328},
+    {0x0119, 0x0065, 0x0328}, {0x011A, 0x0045, 0x030C}, {0x011B, 0x0065, 0x030C}, {0x011C, 0x0047, 0x0302},
+    {0x011D, 0x0067, 0x0302}, {0x011E, 0x0047, 0x0306}, {0x011F, 0x0067, 0x0306}, {0x0120, 0x0047, 0x0307},
+    {0x0121, 0x0067, 0x0307}, {0x0122, 0x0047, 0x0327}, {0x0123, 0x0067, 0x0327}, {0x0124, 0x0048, 0x0302},
+    {0x0125, 0x0068, 0x0302}, {0x0128, 0x0049, 0x0303}, {0x0129, 0x0069, 0x0303}, {0x012A, 0x0049, 0x0304},
+    {0x012B, 0x0069, 0x0304}, {0x012C, 0x0049, 0x0306}, {0x012D, 0x0069, 0x0306}, {0x012E, 0x0049, 0x0328},
+    {0x012F, 0x0069, 0x0328}, {0x0130, 0x0049, 0x0307}, {0x0134, 0x004A, 0x0302}, {0x0135, 0x006A, 0x0302},
+    {0x0136, 0x004B, 0x0327}, {0x0137, 0x006B, 0x0327}, {0x0139, 0x004C, 0x0301}, {0x013A, 0x006C, 0x0301},
+    {0x013B, 0x004C, 0x0327}, {0x013C, 0x006C, 0x0327}, {0x013D, 0x004C, 0x030C}, {0x013E, 0x006C, 0x030C},
+    {0x0143, 0x004E, 0x0301}, {0x0144, 0x006E, 0x0301}, {0x0145, 0x004E, 0x0327}, {0x0146, 0x006E, 0x0327},
+    {0x0147, 0x004E, 0x030C}, {0x0148, 0x006E, 0x030C}, {0x014C, 0x004F, 0x0304}, {0x014D, 0x006F, 0x0304},
+    {0x014E, 0x004F, 0x0306}, {0x014F, 0x006F, 0x0306}, {0x0150, 0x004F, 0x030B}, {0x0151, 0x006F, 0x030B},
+    {0x0154, 0x0052, 0x0301}, {0x0155, 0x0072, 0x0301}, {0x0156, 0x0052, 0x0327}, {0x0157, 0x0072, 0x0327},
+    {0x0158, 0x0052, 0x030C}, {0x0159, 0x0072, 0x030C}, {0x015A, 0x0053, 0x0301}, {0x015B, 0x0073, 0x0301},
+    {0x015C, 0x0053, 0x0302}, {0x015D, 0x0073, 0x0302}, {0x015E, 0x0053, 0x0327}, {0x015F, 0x0073, 0x0327},
+    {0x0160, 0x0053, 0x030C}, {0x0161, 0x0073, 0x030C}, {0x0162, 0x0054, 0x0327}, {0x0163, 0x0074, 0x0327},
+    {0x0164, 0x0054, 0x030C}, {0x0165, 0x0074, 0x030C}, {0x0168, 0x0055, 0x0303}, {0x0169, 0x0075, 0x0303},
+    {0x016A, 0x0055, 0x0304}, {0x016B, 0x0075, 0x0304}, {0x016C, 0x0055, 0x0306}, {0x016D, 0x0075, 0x0306},
+    {0x016E, 0x0055, 0x030A}, {0x016F, 0x0075, 0x030A}, {0x0170, 0x0055, 0x030B}, {0x0171, 0x0075, 0x030B},
+    {0x0172, 0x0055, 0x0328}, {0x0173, 0x0075, 0x0328}, {0x0174, 0x0057, 0x0302}, {0x0175, 0x0077, 0x0302},
+    {0x0176, 0x0059, 0x0302}, {0x0177, 0x0079, 0x0302}, {0x0178, 0x0059, 0x0308}, {0x0179, 0x005A, 0x0301},
+    {0x017A, 0x007A, 0x0301}, {0x017B, 0x005A, 0x0307}, {0x017C, 0x007A, 0x0307}, {0x017D, 0x005A, 0x030C},
+    {0x017E, 0x007A, 0x030C}, {0x01A0, 0x004F, 0x031B}, {0x01A1, 0x006F, 0x031B}, {0x01AF, 0x0055, 0x031B},
+    {0x01B0, 0x0075, 0x031B}, {0x01CD, 0x0041, 0x030C}, {0x01CE, 0x0061, 0x030C}, {0x01CF, 0x0049, 0x030C},
+    {0x01D0, 0x0069, 0x030C}, {0x01D1, 0x004F, 0x030C}, {0x01D2, 0x006F, 0x030C}, {0x01D3, 0x0055, 0x030C},
+    {0x01D4, 0x0075, 0x030C}, {0x01D5, 0x00DC, 0x0304}, {0x01D6, 0x00FC, 0x0304}, {0x01D7, 0x00DC, 0x0301},
+    {0x01D8, 0x00FC, 0x0301}, {0x01D9, 0x00DC, 0x030C}, {0x01DA, 0x00FC, 0x030C}, {0x01DB, 0x00DC, 0x0300},
+    {0x01DC, 0x00FC, 0x0300}, {0x01DE, 0x00C4, 0x0304}, {0x01DF, 0x00E4, 0x0304}, {0x01E0, 0x0226, 0x0304},
+    {0x01E1, 0x0227, 0x0304}, {0x01E2, 0x00C6, 0x0304}, {0x01E3, 0x00E6, 0x0304}, {0x01E6, 0x0047, 0x030C},
+    {0x01E7, 0x0067, 0x030C}, {0x01E8, 0x004B, 0x030C}, {0x01E9, 0x006B, 0x030C}, {0x01EA, 0x004F, 0x0328},
+    {0x01EB, 0x006F, 0x0328}, {0x01EC, 0x01EA, 0x0304}, {0x01ED, 0x01EB, 0x0304}, {0x01EE, 0x01B7, 0x030C},
+    {0x01EF, 0x0292, 0x030C}, {0x01F0, 0x006A, 0x030C}, {0x01F4, 0x0047, 0x0301}, {0x01F5, 0x0067, 0x0301},
+    {0x01F8, 0x004E, 0x0300}, {0x01F9, 0x006E, 0x0300}, {0x01FA, 0x00C5, 0x0301}, {0x01FB, 0x00E5, 0x0301},
+    {0x01FC, 0x00C6, 0x0301}, {0x01FD, 0x00E6, 0x0301}, {0x01FE, 0x00D8, 0x0301}, {0x01FF, 0x00F8, 0x0301},
+    {0x0200, 0x0041, 0x030F}, {0x0201, 0x0061, 0x030F}, {0x0202, 0x0041, 0x0311}, {0x0203, 0x0061, 0x0311},
+    {0x0204, 0x0045, 0x030F}, {0x0205, 0x0065, 0x030F}, {0x0206, 0x0045, 0x0311}, {0x0207, 0x0065, 0x0311},
+    {0x0208, 0x0049, 0x030F}, {0x0209, 0x0069, 0x030F}, {0x020A, 0x0049, 0x0311}, {0x020B, 0x0069, 0x0311},
+    {0x020C, 0x004F, 0x030F}, {0x020D, 0x006F, 0x030F}, {0x020E, 0x004F, 0x0311}, {0x020F, 0x006F, 0x0311},
+    {0x0210, 0x0052, 0x030F}, {0x0211, 0x0072, 0x030F}, {0x0212, 0x0052, 0x0311}, {0x0213, 0x0072, 0x0311},
+    {0x0214, 0x0055, 0x030F}, {0x0215, 0x0075, 0x030F}, {0x0216, 0x0055, 0x0311}, {0x0217, 0x0075, 0x0311},
+    {0x0218, 0x0053, 0x0326}, {0x0219, 0x0073, 0x0326}, {0x021A, 0x0054, 0x0326}, {0x021B, 0x0074, 0x0326},
+    {0x021E, 0x0048, 0x030C}, {0x021F, 0x0068, 0x030C}, {0x0226, 0x0041, 0x0307}, {0x0227, 0x0061, 0x0307},
+    {0x0228, 0x0045, 0x0327}, {0x0229, 0x0065, 0x0327}, {0x022A, 0x00D6, 0x0304}, {0x022B, 0x00F6, 0x0304},
+    {0x022C, 0x00D5, 0x0304}, {0x022D, 0x00F5, 0x0304}, {0x022E, 0x004F, 0x0307}, {0x022F, 0x006F, 0x0307},
+    {0x0230, 0x022E, 0x0304}, {0x0231, 0x022F, 0x0304}, {0x0232, 0x0059, 0x0304}, {0x0233, 0x0079, 0x0304},
+    {0x0340, 0x0300, 0}, {0x0341, 0x0301, 0}, {0x0343, 0x0313, 0}, {0x0344, 0x0308, 0x0301},
+    {0x0374, 0x02B9, 0}, {0x037E, 0x003B, 0}, {0x0385, 0x00A8, 0x0301}, {0x0386, 0x0391, 0x0301},
+    {0x0387, 0x00B7, 0}, {0x0388, 0x0395, 0x0301}, {0x0389, 0x0397, 0x0301}, {0x038A, 0x0399, 0x0301},
+    {0x038C, 0x039F, 0x0301}, {0x038E, 0x03A5, 0x0301}, {0x038F, 0x03A9, 0x0301}, {0x0390, 0x03CA, 0x0301},
+    {0x03AA, 0x0399, 0x0308}, {0x03AB, 0x03A5, 0x0308}, {0x03AC, 0x03B1, 0x0301}, {0x03AD, 0x03B5, 0x0301},
+    {0x03AE, 0x03B7, 0x0301}, {0x03AF, 0x03B9, 0x0301}, {0x03B0, 0x03CB, 0x0301}, {0x03CA, 0x03B9, 0x0308},
+    {0x03CB, 0x03C5, 0x0308}, {0x03CC, 0x03BF, 0x0301}, {0x03CD, 0x03C5, 0x0301}, {0x03CE, 0x03C9, 0x0301},
+    {0x03D3, 0x03D2, 0x0301}, {0x03D4, 0x03D2, 0x0308}, {0x0400, 0x0415, 0x0300}, {0x0401, 0x0415, 0x0308},
+    {0x0403, 0x0413, 0x0301}, {0x0407, 0x0406, 0x0308}, {0x040C, 0x041A, 0x0301}, {0x040D, 0x0418, 0x0300},
+    {0x040E, 0x0423, 0x0306}, {0x0419, 0x0418, 0x0306}, {0x0439, 0x0438, 0x0306}, {0x0450, 0x0435, 0x0300},
+    {0x0451, 0x0435, 0x0308}, {0x0453, 0x0433, 0x0301}, {0x0457, 0x0456, 0x0308}, {0x045C, 0x043A, 0x0301},
+    {0x045D, 0x0438, 0x0300}, {0x045E, 0x0443, 0x0306}, {0x0476, 0x0474, 0x030F}, {0x0477, 0x0475, 0x030F},
+    {0x04C1, 0x0416, 0x0306}, {0x04C2, 0x0436, 0x0306}, {0x04D0, 0x0410, 0x0306}, {0x04D1, 0x0430, 0x0306},
+    {0x04D2, 0x0410, 0x0308}, {0x04D3, 0x0430, 0x0308}, {0x04D6, 0x0415, 0x0306}, {0x04D7, 0x0435, 0x0306},
+    {0x04DA, 0x04D8, 0x0308}, {0x04DB, 0x04D9, 0x0308}, {0x04DC, 0x0416, 0x0308}, {0x04DD, 0x0436, 0x0308},
+    {0x04DE, 0x0417, 0x0308}, {0x04DF, 0x0437, 0x0308}, {0x04E2, 0x0418, 0x0304}, {0x04E3, 0x0438, 0x0304},
+    {0x04E4, 0x0418, 0x0308}, {0x04E5, 0x0438, 0x0308}, {0x04E6, 0x041E, 0x0308}, {0x04E7, 0x043E, 0x0308},
+    {0x04EA, 0x04E8, 0x0308}, {0x04EB, 0x04E9, 0x0308}, {0x04EC, 0x042D, 0x0308}, {0x04ED, 0x044D, 0x0308},
+    {0x04EE, 0x0423, 0x0304}, {0x04EF, 0x0443, 0x0304}, {0x04F0, 0x0423, 0x0308}, {0x04F1, 0x0443, 0x0308},
+    {0x04F2, 0x0423, 0x030B}, {0x04F3, 0x0443, 0x030B}, {0x04F4, 0x0427, 0x0308}, {0x04F5, 0x0447, 0x0308},
+    {0x04F8, 0x042B, 0x0308}, {0x04F9, 0x044B, 0x0308}, {0x0622, 0x0627, 0x0653}, {0x0623, 0x0627, 0x0654},
+    {0x0624, 0x0648, 0x0654}, {0x0625, 0x0627, 0x0655}, {0x0626, 0x064A, 0x0654}, {0x06C0, 0x06D5, 0x0654},
+    {0x06C2, 0x06C1, 0x0654}, {0x06D3, 0x06D2, 0x0654}, {0x0929, 0x0928, 0x093C}, {0x0931, 0x0930, 0x093C},
+    {0x0934, 0x0933, 0x093C}, {0x0958, 0x0915, 0x093C}, {0x0959, 0x0916, 0x093C}, {0x095A, 0x0917, 0x093C},
+    {0x095B, 0x091C, 0x093C}, {0x095C, 0x0921, 0x093C}, {0x095D, 0x0922, 0x093C}, {0x095E, 0x092B, 0x093C},
+    {0x095F, 0x092F, 0x093C}, {0x09CB, 0x09C7, 0x09BE}, {0x09CC, 0x09C7, 0x09D7}, {0x09DC, 0x09A1, 0x09BC},
+    {0x09DD, 0x09A2, 0x09BC}, {0x09DF, 0x09AF, 0x09BC}, {0x0A33, 0x0A32, 0x0A3C}, {0x0A36, 0x0A38, 0x0A3C},
+    {0x0A59, 0x0A16, 0x0A3C}, {0x0A5A, 0x0A17, 0x0A3C}, {0x0A5B, 0x0A1C, 0x0A3C}, {0x0A5E, 0x0A2B, 0x0A3C},
+    {0x0B48, 0x0B47, 0x0B56}, {0x0B4B, 0x0B47, 0x0B3E}, {0x0B4C, 0x0B47, 0x0B57}, {0x0B5C, 0x0B21, 0x0B3C},
+    {0x0B5D, 0x0B22, 0x0B3C}, {0x0B94, 0x0B92, 0x0BD7}, {0x0BCA, 0x0BC6, 0x0BBE}, {0x0BCB, 0x0BC7, 0x0BBE},
+    {0x0BCC, 0x0BC6, 0x0BD7}, {0x0C48, 0x0C46, 0x0C56}, {0x0CC0, 0x0CBF, 0x0CD5}, {0x0CC7, 0x0CC6, 0x0CD5},
+    {0x0CC8, 0x0CC6, 0x0CD6}, {0x0CCA, 0x0CC6, 0x0CC2}, {0x0CCB, 0x0CCA, 0x0CD5}, {0x0D4A, 0x0D46, 0x0D3E},
+    {0x0D4B, 0x0D47, 0x0D3E}, {0x0D4C, 0x0D46, 0x0D57}, {0x0DDA, 0x0DD9, 0x0DCA}, {0x0DDC, 0x0DD9, 0x0DCF},
+    {0x0DDD, 0x0DDC, 0x0DCA}, {0x0DDE, 0x0DD9, 0x0DDF}, {0x0F43, 0x0F42, 0x0FB7}, {0x0F4D, 0x0F4C, 0x0FB7},
+    {0x0F52, 0x0F51, 0x0FB7}, {0x0F57, 0x0F56, 0x0FB7}, {0x0F5C, 0x0F5B, 0x0FB7}, {0x0F69, 0x0F40, 0x0FB5},
+    {0x0F73, 0x0F71, 0x0F72}, {0x0F75, 0x0F71, 0x0F74}, {0x0F76, 0x0FB2, 0x0F80}, {0x0F78, 0x0FB3, 0x0F80},
+    {0x0F81, 0x0F71, 0x0F80}, {0x0F93, 0x0F92, 0x0FB7}, {0x0F9D, 0x0F9C, 0x0FB7}, {0x0FA2, 0x0FA1, 0x0FB7},
+    {0x0FA7, 0x0FA6, 0x0FB7}, {0x0FAC, 0x0FAB, 0x0FB7}, {0x0FB9, 0x0F90, 0x0FB5}, {0x1026, 0x1025, 0x102E},
+    {0x1B06, 0x1B05, 0x1B35}, {0x1B08, 0x1B07, 0x1B35}, {0x1B0A, 0x1B09, 0x1B35}, {0x1B0C, 0x1B0B, 0x1B35},
+    {0x1B0E, 0x1B0D, 0x1B35}, {0x1B12, 0x1B11, 0x1B35}, {0x1B3B, 0x1B3A, 0x1B35}, {0x1B3D, 0x1B3C, 0x1B35},
+    {0x1B40, 0x1B3E, 0x1B35}, {0x1B41, 0x1B3F, 0x1B35}, {0x1B43, 0x1B42, 0x1B35}, {0x1E00, 0x0041, 0x0325},
+    {0x1E01, 0x0061, 0x0325}, {0x1E02, 0x0042, 0x0307}, {0x1E03, 0x0062, 0x0307}, {0x1E04, 0x0042, 0x0323},
+    {0x1E05, 0x0062, 0x0323}, {0x1E06, 0x0042, 0x0331}, {0x1E07, 0x0062, 0x0331}, {0x1E08, 0x00C7, 0x0301},
+    {0x1E09, 0x00E7, 0x0301}, {0x1E0A, 0x0044, 0x0307}, {0x1E0B, 0x0064, 0x0307}, {0x1E0C, 0x0044, 0x0323},
+    {0x1E0D, 0x0064, 0x0323}, {0x1E0E, 0x0044, 0x0331}, {0x1E0F, 0x0064, 0x0331}, {0x1E10, 0x0044, 0x0327},
+    {0x1E11, 0x0064, 0x0327}, {0x1E12, 0x0044, 0x032D}, {0x1E13, 0x0064, 0x032D}, {0x1E14, 0x0112, 0x0300},
+    {0x1E15, 0x0113, 0x0300}, {0x1E16, 0x0112, 0x0301}, {0x1E17, 0x0113, 0x0301}, {0x1E18, 0x0045, 0x032D},
+    {0x1E19, 0x0065, 0x032D}, {0x1E1A, 0x0045, 0x0330}, {0x1E1B, 0x0065, 0x0330}, {0x1E1C, 0x0228, 0x0306},
+    {0x1E1D, 0x0229, 0x0306}, {0x1E1E, 0x0046, 0x0307}, {0x1E1F, 0x0066, 0x0307}, {0x1E20, 0x0047, 0x0304},
+    {0x1E21, 0x0067, 0x0304}, {0x1E22, 0x0048, 0x0307}, {0x1E23, 0x0068, 0x0307}, {0x1E24, 0x0048, 0x0323},
+    {0x1E25, 0x0068, 0x0323}, {0x1E26, 0x0048, 0x0308}, {0x1E27, 0x0068, 0x0308}, {0x1E28, 0x0048, 0x0327},
+    {0x1E29, 0x0068, 0x0327}, {0x1E2A, 0x0048, 0x032E}, {0x1E2B, 0x0068, 0x032E}, {0x1E2C, 0x0049, 0x0330},
+    {0x1E2D, 0x0069, 0x0330}, {0x1E2E, 0x00CF, 0x0301}, {0x1E2F, 0x00EF, 0x0301}, {0x1E30, 0x004B, 0x0301},
+    {0x1E31, 0x006B, 0x0301}, {0x1E32, 0x004B, 0x0323}, {0x1E33, 0x006B, 0x0323}, {0x1E34, 0x004B, 0x0331},
+    {0x1E35, 0x006B, 0x0331}, {0x1E36, 0x004C, 0x0323}, {0x1E37, 0x006C, 0x0323}, {0x1E38, 0x1E36, 0x0304},
+    {0x1E39, 0x1E37, 0x0304}, {0x1E3A, 0x004C, 0x0331}, {0x1E3B, 0x006C, 0x0331}, {0x1E3C, 0x004C, 0x032D},
+    {0x1E3D, 0x006C, 0x032D}, {0x1E3E, 0x004D, 0x0301}, {0x1E3F, 0x006D, 0x0301}, {0x1E40, 0x004D, 0x0307},
+    {0x1E41, 0x006D, 0x0307}, {0x1E42, 0x004D, 0x0323}, {0x1E43, 0x006D, 0x0323}, {0x1E44, 0x004E, 0x0307},
+    {0x1E45, 0x006E, 0x0307}, {0x1E46, 0x004E, 0x0323}, {0x1E47, 0x006E, 0x0323}, {0x1E48, 0x004E, 0x0331},
+    {0x1E49, 0x006E, 0x0331}, {0x1E4A, 0x004E, 0x032D}, {0x1E4B, 0x006E, 0x032D}, {0x1E4C, 0x00D5, 0x0301},
+    {0x1E4D, 0x00F5, 0x0301}, {0x1E4E, 0x00D5, 0x0308}, {0x1E4F, 0x00F5, 0x0308}, {0x1E50, 0x014C, 0x0300},
+    {0x1E51, 0x014D, 0x0300}, {0x1E52, 0x014C, 0x0301}, {0x1E53, 0x014D, 0x0301}, {0x1E54, 0x0050, 0x0301},
+    {0x1E55, 0x0070, 0x0301}, {0x1E56, 0x0050, 0x0307}, {0x1E57, 0x0070, 0x0307}, {0x1E58, 0x0052, 0x0307},
+    {0x1E59, 0x0072, 0x0307}, {0x1E5A, 0x0052, 0x0323}, {0x1E5B, 0x0072, 0x0323}, {0x1E5C, 0x1E5A, 0x0304},
+    {0x1E5D, 0x1E5B, 0x0304}, {0x1E5E, 0x0052, 0x0331}, {0x1E5F, 0x0072, 0x0331}, {0x1E60, 0x0053, 0x0307},
+    {0x1E61, 0x0073, 0x0307}, {0x1E62, 0x0053, 0x0323}, {0x1E63, 0x0073, 0x0323}, {0x1E64, 0x015A, 0x0307},
+    {0x1E65, 0x015B, 0x0307}, {0x1E66, 0x0160, 0x0307}, {0x1E67, 0x0161, 0x0307}, {0x1E68, 0x1E62, 0x0307},
+    {0x1E69, 0x1E63, 0x0307}, {0x1E6A, 0x0054, 0x0307}, {0x1E6B, 0x0074, 0x0307}, {0x1E6C, 0x0054, 0x0323},
+    {0x1E6D, 0x0074, 0x0323}, {0x1E6E, 0x0054, 0x0331}, {0x1E6F, 0x0074, 0x0331}, {0x1E70, 0x0054, 0x032D},
+    {0x1E71, 0x0074, 0x032D}, {0x1E72, 0x0055, 0x0324}, {0x1E73, 0x0075, 0x0324}, {0x1E74, 0x0055, 0x0330},
+    {0x1E75, 0x0075, 0x0330}, {0x1E76, 0x0055, 0x032D}, {0x1E77, 0x0075, 0x032D}, {0x1E78, 0x0168, 0x0301},
+    {0x1E79, 0x0169, 0x0301}, {0x1E7A, 0x016A, 0x0308}, {0x1E7B, 0x016B, 0x0308}, {0x1E7C, 0x0056, 0x0303},
+    {0x1E7D, 0x0076, 0x0303}, {0x1E7E, 0x0056, 0x0323}, {0x1E7F, 0x0076, 0x0323}, {0x1E80, 0x0057, 0x0300},
+    {0x1E81, 0x0077, 0x0300}, {0x1E82, 0x0057, 0x0301}, {0x1E83, 0x0077, 0x0301}, {0x1E84, 0x0057, 0x0308},
+    {0x1E85, 0x0077, 0x0308}, {0x1E86, 0x0057, 0x0307}, {0x1E87, 0x0077, 0x0307}, {0x1E88, 0x0057, 0x0323},
+    {0x1E89, 0x0077, 0x0323}, {0x1E8A, 0x0058, 0x0307}, {0x1E8B, 0x0078, 0x0307}, {0x1E8C, 0x0058, 0x0308},
+    {0x1E8D, 0x0078, 0x0308}, {0x1E8E, 0x0059, 0x0307}, {0x1E8F, 0x0079, 0x0307}, {0x1E90, 0x005A, 0x0302},
+    {0x1E91, 0x007A, 0x0302}, {0x1E92, 0x005A, 0x0323}, {0x1E93, 0x007A, 0x0323}, {0x1E94, 0x005A, 0x0331},
+    {0x1E95, 0x007A, 0x0331}, {0x1E96, 0x0068, 0x0331}, {0x1E97, 0x0074, 0x0308}, {0x1E98, 0x0077, 0x030A},
+    {0x1E99, 0x0079, 0x030A}, {0x1E9B, 0x017F, 0x0307}, {0x1EA0, 0x0041, 0x0323}, {0x1EA1, 0x0061, 0x0323},
+    {0x1EA2, 0x0041, 0x0309}, {0x1EA3, 0x0061, 0x0309}, {0x1EA4, 0x00C2, 0x0301}, {0x1EA5, 0x00E2, 0x0301},
+    {0x1EA6, 0x00C2, 0x0300}, {0x1EA7, 0x00E2, 0x0300}, {0x1EA8, 0x00C2, 0x0309}, {0x1EA9, 0x00E2, 0x0309},
+    {0x1EAA, 0x00C2, 0x0303}, {0x1EAB, 0x00E2, 0x0303}, {0x1EAC, 0x1EA0, 0x0302}, {0x1EAD, 0x1EA1, 0x0302},
+    {0x1EAE, 0x0102, 0x0301}, {0x1EAF, 0x0103, 0x0301}, {0x1EB0, 0x0102, 0x0300}, {0x1EB1, 0x0103, 0x0300},
+    {0x1EB2, 0x0102, 0x0309}, {0x1EB3, 0x0103, 0x0309}, {0x1EB4, 0x0102, 0x0303}, {0x1EB5, 0x0103, 0x0303},
+    {0x1EB6, 0x1EA0, 0x0306}, {0x1EB7, 0x1EA1, 0x0306}, {0x1EB8, 0x0045, 0x0323}, {0x1EB9, 0x0065, 0x0323},
+    {0x1EBA, 0x0045, 0x0309}, {0x1EBB, 0x0065, 0x0309}, {0x1EBC, 0x0045, 0x0303}, {0x1EBD, 0x0065, 0x0303},
+    {0x1EBE, 0x00CA, 0x0301}, {0x1EBF, 0x00EA, 0x0301}, {0x1EC0, 0x00CA, 0x0300}, {0x1EC1, 0x00EA, 0x0300},
+    {0x1EC2, 0x00CA, 0x0309}, {0x1EC3, 0x00EA, 0x0309}, {0x1EC4, 0x00CA, 0x0303}, {0x1EC5, 0x00EA, 0x0303},
+    {0x1EC6, 0x1EB8, 0x0302}, {0x1EC7, 0x1EB9, 0x0302}, {0x1EC8, 0x0049, 0x0309}, {0x1EC9, 0x0069, 0x0309},
+    {0x1ECA, 0x0049, 0x0323}, {0x1ECB, 0x0069, 0x0323}, {0x1ECC, 0x004F, 0x0323}, {0x1ECD, 0x006F, 0x0323},
+    {0x1ECE, 0x004F, 0x0309}, {0x1ECF, 0x006F, 0x0309}, {0x1ED0, 0x00D4, 0x0301}, {0x1ED1, 0x00F4, 0x0301},
+    {0x1ED2, 0x00D4, 0x0300}, {0x1ED3, 0x00F4, 0x0300}, {0x1ED4, 0x00D4, 0x0309}, {0x1ED5, 0x00F4, 0x0309},
+    {0x1ED6, 0x00D4, 0x0303}, {0x1ED7, 0x00F4, 0x0303}, {0x1ED8, 0x1ECC, 0x0302}, {0x1ED9, 0x1ECD, 0x0302},
+    {0x1EDA, 0x01A0, 0x0301}, {0x1EDB, 0x01A1, 0x0301}, {0x1EDC, 0x01A0, 0x0300}, {0x1EDD, 0x01A1, 0x0300},
+    {0x1EDE, 0x01A0, 0x0309}, {0x1EDF, 0x01A1, 0x0309}, {0x1EE0, 0x01A0, 0x0303}, {0x1EE1, 0x01A1, 0x0303},
+    {0x1EE2, 0x01A0, 0x0323}, {0x1EE3, 0x01A1, 0x0323}, {0x1EE4, 0x0055, 0x0323}, {0x1EE5, 0x0075, 0x0323},
+    {0x1EE6, 0x0055, 0x0309}, {0x1EE7, 0x0075, 0x0309}, {0x1EE8, 0x01AF, 0x0301}, {0x1EE9, 0x01B0, 0x0301},
+    {0x1EEA, 0x01AF, 0x0300}, {0x1EEB, 0x01B0, 0x0300}, {0x1EEC, 0x01AF, 0x0309}, {0x1EED, 0x01B0, 0x0309},
+    {0x1EEE, 0x01AF, 0x0303}, {0x1EEF, 0x01B0, 0x0303}, {0x1EF0, 0x01AF, 0x0323}, {0x1EF1, 0x01B0, 0x0323},
+    {0x1EF2, 0x0059, 0x0300}, {0x1EF3, 0x0079, 0x0300}, {0x1EF4, 0x0059, 0x0323}, {0x1EF5, 0x0079, 0x0323},
+    {0x1EF6, 0x0059, 0x0309}, {0x1EF7, 0x0079, 0x0309}, {0x1EF8, 0x0059, 0x0303}, {0x1EF9, 0x0079, 0x0303},
+    {0x1F00, 0x03B1, 0x0313}, {0x1F01, 0x03B1, 0x0314}, {0x1F02, 0x1F00, 0x0300}, {0x1F03, 0x1F01, 0x0300},
+    {0x1F04, 0x1F00, 0x0301}, {0x1F05, 0x1F01, 0x0301}, {0x1F06, 0x1F00, 0x0342}, {0x1F07, 0x1F01, 0x0342},
+    {0x1F08, 0x0391, 0x0313}, {0x1F09, 0x0391, 0x0314}, {0x1F0A, 0x1F08, 0x0300}, {0x1F0B, 0x1F09, 0x0300},
+    {0x1F0C, 0x1F08, 0x0301}, {0x1F0D, 0x1F09, 0x0301}, {0x1F0E, 0x1F08, 0x0342}, {0x1F0F, 0x1F09, 0x0342},
+    {0x1F10, 0x03B5, 0x0313}, {0x1F11, 0x03B5, 0x0314}, {0x1F12, 0x1F10, 0x0300}, {0x1F13, 0x1F11, 0x0300},
+    {0x1F14, 0x1F10, 0x0301}, {0x1F15, 0x1F11, 0x0301}, {0x1F18, 0x0395, 0x0313}, {0x1F19, 0x0395, 0x0314},
+    {0x1F1A, 0x1F18, 0x0300}, {0x1F1B, 0x1F19, 0x0300}, {0x1F1C, 0x1F18, 0x0301}, {0x1F1D, 0x1F19, 0x0301},
+    {0x1F20, 0x03B7, 0x0313}, {0x1F21, 0x03B7, 0x0314}, {0x1F22, 0x1F20, 0x0300}, {0x1F23, 0x1F21, 0x0300},
+    {0x1F24, 0x1F20, 0x0301}, {0x1F25, 0x1F21, 0x0301}, {0x1F26, 0x1F20, 0x0342}, {0x1F27, 0x1F21, 0x0342},
+    {0x1F28, 0x0397, 0x0313}, {0x1F29, 0x0397, 0x0314}, {0x1F2A, 0x1F28, 0x0300}, {0x1F2B, 0x1F29, 0x0300},
+    {0x1F2C, 0x1F28, 0x0301}, {0x1F2D, 0x1F29, 0x0301}, {0x1F2E, 0x1F28, 0x0342}, {0x1F2F, 0x1F29, 0x0342},
+    {0x1F30, 0x03B9, 0x0313}, {0x1F31, 0x03B9, 0x0314}, {0x1F32, 0x1F30, 0x0300}, {0x1F33, 0x1F31, 0x0300},
+    {0x1F34, 0x1F30, 0x0301}, {0x1F35, 0x1F31, 0x0301}, {0x1F36, 0x1F30, 0x0342}, {0x1F37, 0x1F31, 0x0342},
+    {0x1F38, 0x0399, 0x0313}, {0x1F39, 0x0399, 0x0314}, {0x1F3A, 0x1F38, 0x0300}, {0x1F3B, 0x1F39, 0x0300},
+    {0x1F3C, 0x1F38, 0x0301}, {0x1F3D, 0x1F39, 0x0301}, {0x1F3E, 0x1F38, 0x0342}, {0x1F3F, 0x1F39, 0x0342},
+    {0x1F40, 0x03BF, 0x0313}, {0x1F41, 0x03BF, 0x0314}, {0x1F42, 0x1F40, 0x0300}, {0x1F43, 0x1F41, 0x0300},
+    {0x1F44, 0x1F40, 0x0301}, {0x1F45, 0x1F41, 0x0301}, {0x1F48, 0x039F, 0x0313}, {0x1F49, 0x039F, 0x0314},
+    {0x1F4A, 0x1F48, 0x0300}, {0x1F4B, 0x1F49, 0x0300}, {0x1F4C, 0x1F48, 0x0301}, {0x1F4D, 0x1F49, 0x0301},
+    {0x1F50, 0x03C5, 0x0313}, {0x1F51, 0x03C5, 0x0314}, {0x1F52, 0x1F50, 0x0300}, {0x1F53, 0x1F51, 0x0300},
+    {0x1F54, 0x1F50, 0x0301}, {0x1F55, 0x1F51, 0x0301}, {0x1F56, 0x1F50, 0x0342}, {0x1F57, 0x1F51, 0x0342},
+    {0x1F59, 0x03A5, 0x0314}, {0x1F5B, 0x1F59, 0x0300}, {0x1F5D, 0x1F59, 0x0301}, {0x1F5F, 0x1F59, 0x0342},
+    {0x1F60, 0x03C9, 0x0313}, {0x1F61, 0x03C9, 0x0314}, {0x1F62, 0x1F60, 0x0300}, {0x1F63, 0x1F61, 0x0300},
+    {0x1F64, 0x1F60, 0x0301}, {0x1F65, 0x1F61, 0x0301}, {0x1F66, 0x1F60, 0x0342}, {0x1F67, 0x1F61, 0x0342},
+    {0x1F68, 0x03A9, 0x0313}, {0x1F69, 0x03A9, 0x0314}, {0x1F6A, 0x1F68, 0x0300}, {0x1F6B, 0x1F69, 0x0300},
+    {0x1F6C, 0x1F68, 0x0301}, {0x1F6D, 0x1F69, 0x0301}, {0x1F6E, 0x1F68, 0x0342}, {0x1F6F, 0x1F69, 0x0342},
+    {0x1F70, 0x03B1, 0x0300}, {0x1F71, 0x03AC, 0}, {0x1F72, 0x03B5, 0x0300}, {0x1F73, 0x03AD, 0},
+    {0x1F74, 0x03B7, 0x0300}, {0x1F75, 0x03AE, 0}, {0x1F76, 0x03B9, 0x0300}, {0x1F77, 0x03AF, 0},
+    {0x1F78, 0x03BF, 0x0300}, {0x1F79, 0x03CC, 0}, {0x1F7A, 0x03C5, 0x0300}, {0x1F7B, 0x03CD, 0},
+    {0x1F7C, 0x03C9, 0x0300}, {0x1F7D, 0x03CE, 0}, {0x1F80, 0x1F00, 0x0345}, {0x1F81, 0x1F01, 0x0345},
+    {0x1F82, 0x1F02, 0x0345}, {0x1F83, 0x1F03, 0x0345}, {0x1F84, 0x1F04, 0x0345}, {0x1F85, 0x1F05, 0x0345},
+    {0x1F86, 0x1F06, 0x0345}, {0x1F87, 0x1F07, 0x0345}, {0x1F88, 0x1F08, 0x0345}, {0x1F89, 0x1F09, 0x0345},
+    {0x1F8A, 0x1F0A, 0x0345}, {0x1F8B, 0x1F0B, 0x0345}, {0x1F8C, 0x1F0C, 0x0345}, {0x1F8D, 0x1F0D, 0x0345},
+    {0x1F8E, 0x1F0E, 0x0345}, {0x1F8F, 0x1F0F, 0x0345}, {0x1F90, 0x1F20, 0x0345}, {0x1F91, 0x1F21, 0x0345},
+    {0x1F92, 0x1F22, 0x0345}, {0x1F93, 0x1F23, 0x0345}, {0x1F94, 0x1F24, 0x0345}, {0x1F95, 0x1F25, 0x0345},
+    {0x1F96, 0x1F26, 0x0345}, {0x1F97, 0x1F27, 0x0345}, {0x1F98, 0x1F28, 0x0345}, {0x1F99, 0x1F29, 0x0345},
+    {0x1F9A, 0x1F2A, 0x0345}, {0x1F9B, 0x1F2B, 0x0345}, {0x1F9C, 0x1F2C, 0x0345}, {0x1F9D, 0x1F2D, 0x0345},
+    {0x1F9E, 0x1F2E, 0x0345}, {0x1F9F, 0x1F2F, 0x0345}, {0x1FA0, 0x1F60, 0x0345}, {0x1FA1, 0x1F61, 0x0345},
+    {0x1FA2, 0x1F62, 0x0345}, {0x1FA3, 0x1F63, 0x0345}, {0x1FA4, 0x1F64, 0x0345}, {0x1FA5, 0x1F65, 0x0345},
+    {0x1FA6, 0x1F66, 0x0345}, {0x1FA7, 0x1F67, 0x0345}, {0x1FA8, 0x1F68, 0x0345}, {0x1FA9, 0x1F69, 0x0345},
+    {0x1FAA, 0x1F6A, 0x0345}, {0x1FAB, 0x1F6B, 0x0345}, {0x1FAC, 0x1F6C, 0x0345}, {0x1FAD, 0x1F6D, 0x0345},
+    {0x1FAE, 0x1F6E, 0x0345}, {0x1FAF, 0x1F6F, 0x0345}, {0x1FB0, 0x03B1, 0x0306}, {0x1FB1, 0x03B1, 0x0304},
+    {0x1FB2, 0x1F70, 0x0345}, {0x1FB3, 0x03B1, 0x0345}, {0x1FB4, 0x03AC, 0x0345}, {0x1FB6, 0x03B1, 0x0342},
+    {0x1FB7, 0x1FB6, 0x0345}, {0x1FB8, 0x0391, 0x0306}, {0x1FB9, 0x0391, 0x0304}, {0x1FBA, 0x0391, 0x0300},
+    {0x1FBB, 0x0386, 0}, {0x1FBC, 0x0391, 0x0345}, {0x1FBE, 0x03B9, 0}, {0x1FC1, 0x00A8, 0x0342},
+    {0x1FC2, 0x1F74, 0x0345}, {0x1FC3, 0x03B7, 0x0345}, {0x1FC4, 0x03AE, 0x0345}, {0x1FC6, 0x03B7, 0x0342},
+    {0x1FC7, 0x1FC6, 0x0345}, {0x1FC8, 0x0395, 0x0300}, {0x1FC9, 0x0388, 0}, {0x1FCA, 0x0397, 0x0300},
+    {0x1FCB, 0x0389, 0}, {0x1FCC, 0x0397, 0x0345}, {0x1FCD, 0x1FBF, 0x0300}, {0x1FCE, 0x1FBF, 0x0301},
+    {0x1FCF, 0x1FBF, 0x0342}, {0x1FD0, 0x03B9, 0x0306}, {0x1FD1, 0x03B9, 0x0304}, {0x1FD2, 0x03CA, 0x0300},
+    {0x1FD3, 0x0390, 0}, {0x1FD6, 0x03B9, 0x0342}, {0x1FD7, 0x03CA, 0x0342}, {0x1FD8, 0x0399, 0x0306},
+    {0x1FD9, 0x0399, 0x0304}, {0x1FDA, 0x0399, 0x0300}, {0x1FDB, 0x038A, 0}, {0x1FDD, 0x1FFE, 0x0300},
+    {0x1FDE, 0x1FFE, 0x0301}, {0x1FDF, 0x1FFE, 0x0342}, {0x1FE0, 0x03C5, 0x0306}, {0x1FE1, 0x03C5, 0x0304},
+    {0x1FE2, 0x03CB, 0x0300}, {0x1FE3, 0x03B0, 0}, {0x1FE4, 0x03C1, 0x0313}, {0x1FE5, 0x03C1, 0x0314},
+    {0x1FE6, 0x03C5, 0x0342}, {0x1FE7, 0x03CB, 0x0342}, {0x1FE8, 0x03A5, 0x0306}, {0x1FE9, 0x03A5, 0x0304},
+    {0x1FEA, 0x03A5, 0x0300}, {0x1FEB, 0x038E, 0}, {0x1FEC, 0x03A1, 0x0314}, {0x1FED, 0x00A8, 0x0300},
+    {0x1FEE, 0x0385, 0}, {0x1FEF, 0x0060, 0}, {0x1FF2, 0x1F7C, 0x0345}, {0x1FF3, 0x03C9, 0x0345},
+    {0x1FF4, 0x03CE, 0x0345}, {0x1FF6, 0x03C9, 0x0342}, {0x1FF7, 0x1FF6, 0x0345}, {0x1FF8, 0x039F, 0x0300},
+    {0x1FF9, 0x038C, 0}, {0x1FFA, 0x03A9, 0x0300}, {0x1FFB, 0x038F, 0}, {0x1FFC, 0x03A9, 0x0345},
+    {0x1FFD, 0x00B4, 0}, {0x2000, 0x2002, 0}, {0x2001, 0x2003, 0}, {0x2126, 0x03A9, 0},
+    {0x212A, 0x004B, 0}, {0x212B, 0x00C5, 0}, {0x219A, 0x2190, 0x0338}, {0x219B, 0x2192, 0x0338},
+    {0x21AE, 0x2194, 0x0338}, {0x21CD, 0x21D0, 0x0338}, {0x21CE, 0x21D4, 0x0338}, {0x21CF, 0x21D2, 0x0338},
+    {0x2204, 0x2203, 0x0338}, {0x2209, 0x2208, 0x0338}, {0x220C, 0x220B, 0x0338}, {0x2224, 0x2223, 0x0338},
+    {0x2226, 0x2225, 0x0338}, {0x2241, 0x223C, 0x0338}, {0x2244, 0x2243, 0x0338}, {0x2247, 0x2245, 0x0338},
+    {0x2249, 0x2248, 0x0338}, {0x2260, 0x003D, 0x0338}, {0x2262, 0x2261, 0x0338}, {0x226D, 0x224D, 0x0338},
+    {0x226E, 0x003C, 0x0338}, {0x226F, 0x003E, 0x0338}, {0x2270, 0x2264, 0x0338}, {0x2271, 0x2265, 0x0338},
+    {0x2274, 0x2272, 0x0338}, {0x2275, 0x2273, 0x0338}, {0x2278, 0x2276, 0x0338}, {0x2279, 0x2277, 0x0338},
+    {0x2280, 0x227A, 0x0338}, {0x2281, 0x227B, 0x0338}, {0x2284, 0x2282, 0x0338}, {0x2285, 0x2283, 0x0338},
+    {0x2288, 0x2286, 0x0338}, {0x2289, 0x2287, 0x0338}, {0x22AC, 0x22A2, 0x0338}, {0x22AD, 0x22A8, 0x0338},
+    {0x22AE, 0x22A9, 0x0338}, {0x22AF, 0x22AB, 0x0338}, {0x22E0, 0x227C, 0x0338}, {0x22E1, 0x227D, 0x0338},
+    {0x22E2, 0x2291, 0x0338}, {0x22E3, 0x2292, 0x0338}, {0x22EA, 0x22B2, 0x0338}, {0x22EB, 0x22B3, 0x0338},
+    {0x22EC, 0x22B4, 0x0338}, {0x22ED, 0x22B5, 0x0338}, {0x2329, 0x3008, 0}, {0x232A, 0x3009, 0},
+    {0x2ADC, 0x2ADD, 0x0338}, {0x304C, 0x304B, 0x3099}, {0x304E, 0x304D, 0x3099}, {0x3050, 0x304F, 0x3099},
+    {0x3052, 0x3051, 0x3099}, {0x3054, 0x3053, 0x3099}, {0x3056, 0x3055, 0x3099}, {0x3058, 0x3057, 0x3099},
+    {0x305A, 0x3059, 0x3099}, {0x305C, 0x305B, 0x3099}, {0x305E, 0x305D, 0x3099}, {0x3060, 0x305F, 0x3099},
+    {0x3062, 0x3061, 0x3099}, {0x3065, 0x3064, 0x3099}, {0x3067, 0x3066, 0x3099}, {0x3069, 0x3068, 0x3099},
+    {0x3070, 0x306F, 0x3099}, {0x3071, 0x306F, 0x309A}, {0x3073, 0x3072, 0x3099}, {0x3074, 0x3072, 0x309A},
+    {0x3076, 0x3075, 0x3099}, {0x3077, 0x3075, 0x309A}, {0x3079, 0x3078, 0x3099}, {0x307A, 0x3078, 0x309A},
+    {0x307C, 0x307B, 0x3099}, {0x307D, 0x307B, 0x309A}, {0x3094, 0x3046, 0x3099}, {0x309E, 0x309D, 0x3099},
+    {0x30AC, 0x30AB, 0x3099}, {0x30AE, 0x30AD, 0x3099}, {0x30B0, 0x30AF, 0x3099}, {0x30B2, 0x30B1, 0x3099},
+    {0x30B4, 0x30B3, 0x3099}, {0x30B6, 0x30B5, 0x3099}, {0x30B8, 0x30B7, 0x3099}, {0x30BA, 0x30B9, 0x3099},
+    {0x30BC, 0x30BB, 0x3099}, {0x30BE, 0x30BD, 0x3099}, {0x30C0, 0x30BF, 0x3099}, {0x30C2, 0x30C1, 0x3099},
+    {0x30C5, 0x30C4, 0x3099}, {0x30C7, 0x30C6, 0x3099}, {0x30C9, 0x30C8, 0x3099}, {0x30D0, 0x30CF, 0x3099},
+    {0x30D1, 0x30CF, 0x309A}, {0x30D3, 0x30D2, 0x3099}, {0x30D4, 0x30D2, 0x309A}, {0x30D6, 0x30D5, 0x3099},
+    {0x30D7, 0x30D5, 0x309A}, {0x30D9, 0x30D8, 0x3099}, {0x30DA, 0x30D8, 0x309A}, {0x30DC, 0x30DB, 0x3099},
+    {0x30DD, 0x30DB, 0x309A}, {0x30F4, 0x30A6, 0x3099}, {0x30F7, 0x30EF, 0x3099}, {0x30F8, 0x30F0, 0x3099},
+    {0x30F9, 0x30F1, 0x3099}, {0x30FA, 0x30F2, 0x3099}, {0x30FE, 0x30FD, 0x3099}, {0xFB1D, 0x05D9, 0x05B4},
+    {0xFB1F, 0x05F2, 0x05B7}, {0xFB2A, 0x05E9, 0x05C1}, {0xFB2B, 0x05E9, 0x05C2}, {0xFB2C, 0xFB49, 0x05C1},
+    {0xFB2D, 0xFB49, 0x05C2}, {0xFB2E, 0x05D0, 0x05B7}, {0xFB2F, 0x05D0, 0x05B8}, {0xFB30, 0x05D0, 0x05BC},
+    {0xFB31, 0x05D1, 0x05BC}, {0xFB32, 0x05D2, 0x05BC}, {0xFB33, 0x05D3, 0x05BC}, {0xFB34, 0x05D4, 0x05BC},
+    {0xFB35, 0x05D5, 0x05BC}, {0xFB36, 0x05D6, 0x05BC}, {0xFB38, 0x05D8, 0x05BC}, {0xFB39, 0x05D9, 0x05BC},
+    {0xFB3A, 0x05DA, 0x05BC}, {0xFB3B, 0x05DB, 0x05BC}, {0xFB3C, 0x05DC, 0x05BC}, {0xFB3E, 0x05DE, 0x05BC},
+    {0xFB40, 0x05E0, 0x05BC}, {0xFB41, 0x05E1, 0x05BC}, {0xFB43, 0x05E3, 0x05BC}, {0xFB44, 0x05E4, 0x05BC},
+    {0xFB46, 0x05E6, 0x05BC}, {0xFB47, 0x05E7, 0x05BC}, {0xFB48, 0x05E8, 0x05BC}, {0xFB49, 0x05E9, 0x05BC},
+    {0xFB4A, 0x05EA, 0x05BC}, {0xFB4B, 0x05D5, 0x05B9}, {0xFB4C, 0x05D1, 0x05BF}, {0xFB4D, 0x05DB, 0x05BF},
+    {0xFB4E, 0x05E4, 0x05BF}, {0x1109A, 0x11099, 0x110BA}, {0x1109C, 0x1109B, 0x110BA}, {0x110AB, 0x110A5, 0x110BA},
+    {0x1112E, 0x11131, 0x11127}, {0x1112F, 0x11132, 0x11127}, {0x1134B, 0x11347, 0x1133E}, {0x1134C, 0x11347, 0x11357},
+    {0x114BB, 0x114B9, 0x114BA}, {0x114BC, 0x114B9, 0x114B0}, {0x114BE, 0x114B9, 0x114BD}, {0x115BA, 0x115B8, 0x115AF},
+    {0x115BB, 0x115B9, 0x115AF}, {0x11938, 0x11935, 0x11930}, {0x1D15E, 0x1D157, 0x1D165}, {0x1D15F, 0x1D158, 0x1D165},
+    {0x1D160, 0x1D15F, 0x1D16E}, {0x1D161, 0x1D15F, 0x1D16F}, {0x1D162, 0x1D15F, 0x1D170}, {0x1D163, 0x1D15F, 0x1D171},
+    {0x1D164, 0x1D15F, 0x1D172}, {0x1D1BB, 0x1D1B9, 0x1D165}, {0x1D1BC, 0x1D1BA, 0x1D165}, {0x1D1BD, 0x1D1BB, 0x1D16E},
+    {0x1D1BE, 0x1D1BC, 0x1D16E}, {0x1D1BF, 0x1D1BB, 0x1D16F}, {0x1D1C0, 0x1D1BC, 0x1D16F},
+};
+
+// At most this many code points come out of foldCodepoint().
+const int kMaxFoldedCodepoints = 4;
+
+// Full case folding of one code point; returns the number written to out (1 to 3).
+inline int caseFoldCodepoint(char32_t cp, char32_t* out) {
+    if (cp < 0x80) {
+        out[0] = cp >= 'A' && cp <= 'Z' ? cp + 0x20 : cp;
+        return 1;
+    }
+    auto expansion = lower_bound(begin(kFoldExpansions), end(kFoldExpansions), cp,
+                                 [](const FoldExpansion& entry, char32_t value) { return entry.cp < value; });
+    if (expansion != end(kFoldExpansions) && expansion->cp == cp) {
+        int count = 0;
+        while (count < 3 && expansion->folded[count] != 0) {
+            out[count] = expansion->folded[count];
+            ++count;
+        }
+        return count;
+    }
+    auto run = upper_bound(begin(kFoldRuns), end(kFoldRuns), cp,
+                           [](char32_t value, const FoldRun& entry) { return value < entry.first; });
+    out[0] = cp;
+    if (run != begin(kFoldRuns)) {
+        --run;
+        if (cp <= run->last && (cp - run->first) % run->stride == 0) {
+            out[0] = static_cast<char32_t>(static_cast<int32_t>(cp) + run->delta);
+        }
+    }
+    return 1;
+}
+
+// Full canonical decomposition of one code point; returns the number written to out (1 to 4).
+inline int decomposeCodepoint(char32_t cp, char32_t* out) {
+    // Hangul syllables decompose algorithmically into two or three jamo.
+    const char32_t syllableBase = 0xAC00, leadBase = 0x1100, vowelBase = 0x1161, trailBase = 0x11A7;
+    if (cp >= syllableBase && cp < syllableBase + 11172) {
+        char32_t index = cp - syllableBase;
+        out[0] = leadBase + index / 588;
+        out[1] = vowelBase + index % 588 / 28;
+        if (index % 28 == 0) {
+            return 2;
+        }
+        out[2] = trailBase + index % 28;
+        return 3;
+    }
+    auto entry = lower_bound(begin(kDecompositions), end(kDecompositions), cp,
+                             [](const Decomposition& item, char32_t value) { return item.cp < value; });
+    if (entry == end(kDecompositions) || entry->cp != cp) {
+        out[0] = cp;
+        return 1;
+    }
+    // Only the first code point of a decomposition decomposes further.
+    int count = decomposeCodepoint(entry->first, out);
+    if (entry->second != 0) {
+        out[count++] = entry->second;
+    }
+    return count;
+}
+
+/**
+ * @brief Case folds one code point.
+ *
+ * Applies the full Unicode case folding (CaseFolding.txt statuses C and F, so
+ * e.g. "STRASSE" and "stra\u00dfe" fold to the same string). With `compat`
+ * set, fullwidth ASCII, no-break and ideographic spaces and superscript digits
+ * are first mapped to their NFKC equivalents, and precomposed characters are
+ * canonically decomposed before folding, so "\u00e9" and "e\u0301" fold alike.
+ * Combining marks are not reordered.
+ *
+ * @param out Receives the folded code points.
+ * @return The number of code points written to out (1 to kMaxFoldedCodepoints).
+ */
+inline int foldCodepoint(char32_t cp, bool compat, char32_t out[kMaxFoldedCodepoints]) {
+    if (!compat) {
+        return caseFoldCodepoint(cp, out);
+    }
+    if (cp >= 0xFF01 && cp <= 0xFF5E) {
+        cp -= 0xFEE0; // Fullwidth ASCII
+    } else if (cp == 0x00A0 || cp == 0x3000) {
+        cp = ' ';
+    } else if (cp == 0x00B9) {
+        cp = '1';
+    } else if (cp == 0x00B2 || cp == 0x00B3) {
+        cp = '2' + (cp - 0x00B2);
+    } else if (cp == 0x2070) {
+        cp = '0';
+    } else if (cp >= 0x2074 && cp <= 0x2079) {
+        cp = '4' + (cp - 0x2074);
+    }
+
+    char32_t decomposed[kMaxFoldedCodepoints];
+    int parts = decomposeCodepoint(cp, decomposed);
+    int count = 0;
+    for (int k = 0; k < parts; ++k) {
+        char32_t folded[3];
+        int foldedCount = caseFoldCodepoint(decomposed[k], folded);
+        for (int j = 0; j < foldedCount && count < kMaxFoldedCodepoints; ++j) {
+            out[count++] = folded[j];
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Case folds a UTF-8 string code point by code point.
+ *
+ * Bytes that are not part of a well-formed sequence are copied unchanged, so
+ * patterns and text containing them still fold consistently.
+ */
+inline string foldUtf8(string_view s, bool compat) {
+    string folded;
+    folded.reserve(s.size());
+    size_t i = 0;
+    while (i < s.size()) {
+        char32_t cp;
+        size_t length = decodeUtf8(s.data() + i, s.size() - i, cp);
+        if (length == 0) {
+            folded += s[i++];
+            continue;
+        }
+        char32_t out[kMaxFoldedCodepoints];
+        int count = foldCodepoint(cp, compat, out);
+        for (int k = 0; k < count; ++k) {
+            encodeUtf8(out[k], folded);
+        }
+        i += length;
+    }
+    return folded;
+}
+
 // Structure for Trie Node
 struct TrieNode {
-    // Using map for children allows flexibility with character sets (e.g., ASCII, Unicode)
-    // Key: character, Value: pointer to the child node
+    // Key: byte of the (folded) pattern, Value: pointer to the child node.
+    // Unicode patterns are stored as their UTF-8 byte sequences.
     map<char, TrieNode*> children;
 
-    // Failure link: points to the longest proper suffix of the current node's string
-    // that is also a prefix of some pattern.
-    TrieNode* failureLink;
+    // Failure link: points to the longest proper suffix of the current node's string
+    // that is also a prefix of some pattern.
+    TrieNode* failureLink;
+
+    // Points to the nearest pattern-ending node in the failure path
+    TrieNode* outputLink;
+
+    // Stores indices of patterns ending EXACTLY at this node
+    vector<int> patternIndices;
+
+    // Constructor
+    TrieNode() : failureLink(nullptr), outputLink(nullptr) {}
+};
+
+// How pattern and text characters are compared
+enum class CaseFolding {
+    None,  // Exact byte comparison
+    Ascii, // 'A'-'Z' match 'a'-'z'; all other bytes compare exactly
+    Unicode, // UTF-8 text; code points compare after Unicode case folding
+    UnicodeCompat, // Unicode, plus canonical equivalence and NFKC-style width, space and superscript equivalences
+};
+
+// Per-pattern anchoring flags for addPattern(); combine them with |.
+// They are checked inside the scan against the byte before the match and the
+// byte after it, so unanchored candidates are never reported.
+enum Anchor : uint8_t {
+    AnchorNone = 0,
+    AnchorWordStart = 1 << 0,  // Preceded by the start of input or a non-word byte
+    AnchorWordEnd = 1 << 1,    // Followed by the end of input or a non-word byte
+    AnchorLineStart = 1 << 2,  // Preceded by the start of input or '\n'
+    AnchorLineEnd = 1 << 3,    // Followed by the end of input, '\r' or '\n'
+    AnchorInputStart = 1 << 4, // Starts at the first byte of the input
+    AnchorInputEnd = 1 << 5,   // Ends at the last byte of the input
+    AnchorWord = AnchorWordStart | AnchorWordEnd,
+    AnchorLine = AnchorLineStart | AnchorLineEnd,
+};
+
+// Word bytes for AnchorWordStart/AnchorWordEnd: ASCII letters, digits, '_' and
+// every non-ASCII byte, so UTF-8 encoded letters count as part of a word.
+inline bool isWordByte(unsigned char b) {
+    return (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_' || b >= 0x80;
+}
+
+// Anchors that need the byte after a match, which a chunked scan may not have yet.
+const uint8_t kLookaheadAnchors = AnchorWordEnd | AnchorLineEnd | AnchorInputEnd;
+
+/**
+ * @brief Checks the start-side anchors of a candidate match.
+ *
+ * @param before The byte preceding the match, or -1 at the start of the input.
+ */
+inline bool startAnchorsHold(uint8_t anchors, int before) {
+    bool atInputStart = before < 0;
+    if ((anchors & AnchorInputStart) && !atInputStart) return false;
+    if ((anchors & AnchorLineStart) && !atInputStart && before != '\n') return false;
+    if ((anchors & AnchorWordStart) && !atInputStart && isWordByte(before)) return false;
+    return true;
+}
+
+/**
+ * @brief Checks the end-side anchors of a candidate match.
+ *
+ * @param after The byte following the match, or -1 at the end of the input.
+ */
+inline bool endAnchorsHold(uint8_t anchors, int after) {
+    bool atInputEnd = after < 0;
+    if ((anchors & AnchorInputEnd) && !atInputEnd) return false;
+    if ((anchors & AnchorLineEnd) && !atInputEnd && after != '\n' && after != '\r') return false;
+    if ((anchors & AnchorWordEnd) && !atInputEnd && isWordByte(after)) return false;
+    return true;
+}
+
+// A single match reported by AhoCorasick::search() to its callback
+struct Match {
+    int patternIndex;     // Index of the matched pattern
+    size_t startPosition; // Offset in the text (or stream) of the first byte of the match
+    size_t endPosition;   // Offset in the text (or stream) of the last byte of the match
+    uint64_t payload;     // Payload stored with the pattern by addPattern()
+};
+
+/**
+ * @brief Resumable position of a scan over a stream delivered in chunks.
+ *
+ * Created empty, passed to AhoCorasick::scanChunk() for every chunk and to
+ * AhoCorasick::finishScan() at the end of the stream, after which it can be
+ * reused for the next stream. One state serves one stream at a time; many
+ * states can scan with the same automaton concurrently.
+ */
+class ScanState {
+private:
+    friend class AhoCorasick;
+
+    const TrieNode* node = nullptr; // Current automaton state; null before the first byte
+    size_t offset = 0;              // Stream offset of the next byte
+    string history;                 // Bytes just before `offset`, for lookbehind of anchored matches
+    vector<Match> pending;          // Anchored matches waiting for the byte after their end
+
+    // Unicode folding modes only
+    string partial;                 // Incomplete UTF-8 sequence at the end of the last chunk
+    vector<size_t> sourceOffsets;   // Stream offset behind each recent folded byte (a ring)
+    size_t foldedCount = 0;         // Folded bytes fed so far
+
+public:
+    // Number of bytes scanned so far.
+    size_t bytesScanned() const {
+        return offset;
+    }
+};
+
+// Estimated heap footprint of an AhoCorasick in bytes, see AhoCorasick::memoryUsage()
+struct MemoryUsage {
+    size_t states;            // TrieNode structs
+    size_t edges;             // std::map nodes holding the child pointers
+    size_t outputs;           // Output lists and per-pattern anchors, lengths, payloads and duplicate ids
+    size_t patternStorage;    // The stored copies of the patterns
+    size_t allocatorOverhead; // Per-allocation malloc bookkeeping for all of the above
+
+    size_t total() const {
+        return states + edges + outputs + patternStorage + allocatorOverhead;
+    }
+};
+
+// How AhoCorasick keeps the original patterns once they are in the trie
+enum class PatternStorage {
+    Arena,       // All patterns back to back in one string; getPattern() works
+    LengthsOnly, // Only the lengths needed for match offsets; getPattern() returns ""
+};
+
+// Build options for AhoCorasick
+struct AhoCorasickOptions {
+    CaseFolding caseFolding = CaseFolding::None;
+
+    // Adding a pattern whose (folded) key and anchors equal an existing one's
+    // returns the existing index instead of creating a new one, so each distinct
+    // string is reported once per position. The first add's payload is kept.
+    bool deduplicate = false;
+
+    // With deduplicate, also remember every caller id (the 0-based ordinal of the
+    // add) merged into each index; see AhoCorasick::getDuplicateIds().
+    bool keepDuplicateIds = false;
+
+    PatternStorage patternStorage = PatternStorage::Arena;
+
+    // Upper bound in bytes for memoryUsage().total(), or 0 for no limit. Adds that
+    // would exceed it are rejected before anything is allocated.
+    size_t memoryBudget = 0;
+};
+
+class AhoCorasick {
+private:
+    friend class HybridAutomaton;
+
+    TrieNode* root;
+
+    // The original patterns, stored back to back in one arena for reference.
+    // Pattern i (i >= arenaBase) is patternArena[patternOffsets[i - arenaBase],
+    // patternOffsets[i - arenaBase + 1]). With PatternStorage::LengthsOnly the
+    // arena only holds patterns while they are being inserted, and arenaBase
+    // then moves past them.
+    string patternArena;
+    vector<size_t> patternOffsets{0};
+    size_t arenaBase = 0;
+    bool storePatterns;
+
+    vector<uint8_t> patternAnchors; // Anchor flags per pattern index
+    bool hasAnchors = false;        // Whether any pattern has anchors, i.e. scans need history
+    vector<int> patternLengths;     // Length of each pattern's trie key, for match start offsets
+    size_t maxKeyLength = 0;
+    vector<uint64_t> patternPayloads; // Caller payload per pattern index, handed out with each match
+
+    bool deduplicate;
+    bool keepDuplicateIds;
+    int addCount = 0;                 // Patterns added so far, duplicates included (next caller id)
+    vector<vector<int>> duplicateIds; // Caller ids merged into each pattern index, if kept
+
+    // addPatterns() buckets up to this many patterns are never split further.
+    static constexpr size_t kMinSplitBucket = 1024;
+
+    // Counters behind memoryUsage(), kept current by every insertion path so the
+    // estimate and the budget check cost O(1).
+    struct Footprint {
+        size_t nodes = 0;            // Trie nodes, root included
+        size_t outputNodes = 0;      // Nodes with a non-empty patternIndices vector
+        size_t patterns = 0;         // Patterns
+        size_t patternBytes = 0;     // Bytes of those patterns kept in the arena
+
+        void add(const Footprint& other) {
+            nodes += other.nodes;
+            outputNodes += other.outputNodes;
+            patterns += other.patterns;
+            patternBytes += other.patternBytes;
+        }
+
+        void addPattern(size_t storedBytes) {
+            ++patterns;
+            patternBytes += storedBytes;
+        }
+    };
+
+    Footprint footprint;
+    size_t memoryBudget;
+    bool overBudget = false;
+
+    // Capacity of a vector with room for `capacity` elements once it holds
+    // `size`: unchanged if they fit, else doubled and at least the next power
+    // of two, as push_back() grows it and reserveSlots() reserves.
+    static size_t grownCapacity(size_t capacity, size_t size) {
+        if (size <= capacity) {
+            return capacity;
+        }
+        size_t grown = 1;
+        while (grown < size) {
+            grown <<= 1;
+        }
+        return max(2 * capacity, grown);
+    }
+
+    template <typename T>
+    static void reserveSlots(vector<T>& values, size_t size) {
+        values.reserve(grownCapacity(values.capacity(), size));
+    }
+
+    MemoryUsage usageOf(const Footprint& f, size_t callerIds) const {
+        // A red-black tree node: color, parent and two child pointers, then the pair.
+        const size_t kEdgeBytes = 4 * sizeof(void*) + sizeof(pair<const char, TrieNode*>);
+        // glibc chunk header plus average rounding per malloc'd block.
+        const size_t kAllocationOverhead = 2 * sizeof(void*);
+
+        size_t idLists = keepDuplicateIds ? f.patterns : 0;
+        size_t arenaBlocks = storePatterns ? 2 : 0;
+        size_t allocations = f.nodes + (f.nodes - 1) + f.outputNodes + arenaBlocks + idLists;
+
+        // Pattern-indexed arrays and the arena count at the capacity they will have.
+        size_t slots = f.patterns;
+        size_t arenaCapacity = patternArena.capacity();
+        if (f.patternBytes > arenaCapacity) {
+            arenaCapacity = max(2 * arenaCapacity, f.patternBytes);
+        }
+
+        MemoryUsage usage;
+        usage.states = f.nodes * sizeof(TrieNode);
+        usage.edges = (f.nodes - 1) * kEdgeBytes;
+        usage.outputs = f.patterns * sizeof(int) + grownCapacity(patternAnchors.capacity(), slots) * sizeof(uint8_t) +
+                        grownCapacity(patternLengths.capacity(), slots) * sizeof(int) +
+                        grownCapacity(patternPayloads.capacity(), slots) * sizeof(uint64_t) +
+                        (keepDuplicateIds ? grownCapacity(duplicateIds.capacity(), idLists) : 0) * sizeof(vector<int>) +
+                        callerIds * sizeof(int);
+        usage.patternStorage =
+            storePatterns ? arenaCapacity + grownCapacity(patternOffsets.capacity(), slots + 1) * sizeof(size_t) : 0;
+        usage.allocatorOverhead = allocations * kAllocationOverhead;
+        return usage;
+    }
+
+    // Whether growing by `added` (and `addedCallerIds`) would exceed the memory budget.
+    bool exceedsBudget(const Footprint& added, size_t addedCallerIds) const {
+        if (memoryBudget == 0) {
+            return false;
+        }
+        Footprint after = footprint;
+        after.add(added);
+        size_t callerIds = keepDuplicateIds ? addCount + addedCallerIds : 0;
+        return usageOf(after, callerIds).total() > memoryBudget;
+    }
+
+    // Maps every byte to the key used in the trie. Patterns are folded through it
+    // when inserted and text bytes inside search(), so case-insensitive search
+    // costs one table load per byte, exactly like case-sensitive search.
+    char foldTable[256];
+
+    char fold(char ch) const {
+        return foldTable[static_cast<unsigned char>(ch)];
+    }
+
+    // In the Unicode modes the byte table is the identity and patterns are
+    // folded to UTF-8 keys up front, since folding can change their length.
+    CaseFolding caseFolding;
+    vector<string> foldedKeys; // Keys of the patterns being bulk inserted (Unicode modes only)
+
+    bool unicodeFolding() const {
+        return caseFolding == CaseFolding::Unicode || caseFolding == CaseFolding::UnicodeCompat;
+    }
+
+    size_t patternCount() const {
+        return patternLengths.size();
+    }
+
+    // Number of patterns with an entry in the arena, i.e. registered patterns.
+    size_t registeredCount() const {
+        return arenaBase + patternOffsets.size() - 1;
+    }
+
+    string_view storedPattern(size_t patternIndex) const {
+        size_t slot = patternIndex - arenaBase;
+        return string_view(patternArena).substr(patternOffsets[slot], patternOffsets[slot + 1] - patternOffsets[slot]);
+    }
+
+    void appendToArena(string_view pattern) {
+        patternArena.append(pattern.data(), pattern.size());
+        patternOffsets.push_back(patternArena.size());
+    }
+
+    // With PatternStorage::LengthsOnly, forgets the strings of every pattern
+    // inserted so far; only their lengths remain.
+    void dropInsertedStrings() {
+        if (!storePatterns) {
+            string().swap(patternArena);
+            vector<size_t>{0}.swap(patternOffsets);
+            arenaBase = patternCount();
+        }
+    }
+
+    // The byte string inserted into the trie for a pattern, before byte folding.
+    string_view key(int patternIndex) const {
+        return unicodeFolding() ? string_view(foldedKeys[patternIndex]) : storedPattern(patternIndex);
+    }
+
+    // Registers the arena patterns [first, registeredCount()) ahead of a bulk
+    // insert: they are left unanchored with a zero payload, their key lengths are
+    // recorded and, in the Unicode modes, their folded keys are stored in foldedKeys.
+    void prepareKeys(size_t first) {
+        size_t last = registeredCount();
+        reserveSlots(patternAnchors, last);
+        reserveSlots(patternPayloads, last);
+        reserveSlots(patternLengths, last);
+        patternAnchors.resize(last, AnchorNone);
+        patternPayloads.resize(last, 0);
+        patternLengths.resize(last);
+        if (unicodeFolding()) {
+            foldedKeys.resize(last);
+            for (size_t i = first; i < last; ++i) {
+                foldedKeys[i] = foldUtf8(storedPattern(i), caseFolding == CaseFolding::UnicodeCompat);
+            }
+        }
+        for (size_t i = first; i < last; ++i) {
+            recordKeyLength(i, key(i).size());
+        }
+    }
+
+    // Whether two patterns map to the same trie key.
+    bool sameKey(int x, int y) const {
+        string_view a = key(x);
+        string_view b = key(y);
+        return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), [this](char l, char r) {
+            return fold(l) == fold(r);
+        });
+    }
+
+    void noteDuplicateId(int patternIndex, int callerId) {
+        if (keepDuplicateIds) {
+            if (duplicateIds.size() <= static_cast<size_t>(patternIndex)) {
+                reserveSlots(duplicateIds, patternIndex + 1);
+                duplicateIds.resize(patternIndex + 1);
+            }
+            duplicateIds[patternIndex].push_back(callerId);
+        }
+    }
+
+    /**
+     * Drops duplicate keys ahead of a sorted bulk insert into an empty automaton.
+     * Equal keys are adjacent in `order`, earliest input first; that one survives
+     * and the others are removed from `order`. Every pattern keeps its input
+     * position as index, so the dropped ones stay registered but are never
+     * reported. Returns what those registered duplicates occupy.
+     */
+    Footprint mergeSortedDuplicates(vector<int>& order) {
+        size_t n = patternCount();
+        vector<int> canonical(n);
+        for (size_t k = 0; k < order.size(); ++k) {
+            bool repeat = k > 0 && sameKey(order[k - 1], order[k]);
+            canonical[order[k]] = repeat ? canonical[order[k - 1]] : order[k];
+        }
+        Footprint dropped;
+        for (size_t i = 0; i < n; ++i) {
+            noteDuplicateId(canonical[i], i);
+            if (canonical[i] != static_cast<int>(i)) {
+                dropped.addPattern(storePatterns ? storedPattern(i).size() : 0);
+            }
+        }
+
+        vector<int> survivingOrder;
+        survivingOrder.reserve(order.size());
+        for (int patternIndex : order) {
+            if (canonical[patternIndex] == patternIndex) {
+                survivingOrder.push_back(patternIndex);
+            }
+        }
+        order.swap(survivingOrder);
+        return dropped;
+    }
+
+    void releaseKeys() {
+        vector<string>().swap(foldedKeys);
+    }
+
+    // Lexicographic order of the folded patterns, used by the sorted insertions.
+    bool foldedLess(int x, int y) const {
+        string_view a = key(x);
+        string_view b = key(y);
+        return lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [this](char l, char r) {
+            return static_cast<unsigned char>(fold(l)) < static_cast<unsigned char>(fold(r));
+        });
+    }
+
+    // Helper function to recursively delete the trie nodes
+    void deleteTrie(TrieNode* node) {
+        if (!node) return;
+        for (auto const& [key, val] : node->children) {
+            deleteTrie(val);
+        }
+        delete node;
+    }
+
+    // Inserts pattern[depth..] below node and returns the node where it ends.
+    TrieNode* insertPath(TrieNode* node, string_view pattern, size_t depth) {
+        for (size_t i = depth; i < pattern.size(); ++i) {
+            TrieNode*& child = node->children[fold(pattern[i])];
+            if (child == nullptr) {
+                child = new TrieNode();
+                ++footprint.nodes;
+            }
+            node = child;
+        }
+        return node;
+    }
+
+    /**
+     * Inserts patterns[order[*]] below `base`, which sits at depth `depth` of every
+     * one of them, in a single pass over the list. When `order` is lexicographically
+     * sorted each pattern only descends from the point where it diverges from its
+     * predecessor, and every new child is appended at the end of its parent's map.
+     * Unsorted input is still inserted correctly, only without the shortcut.
+     * Created nodes and patterns are counted into `added`.
+     */
+    void insertSorted(const vector<int>& order, size_t depth, TrieNode* base, Footprint& added) {
+        vector<TrieNode*> path{base}; // path[k]: node at depth `depth + k` of the previous pattern
+        string_view previous;
+        bool first = true;
+
+        for (int patternIndex : order) {
+            string_view pattern = key(patternIndex);
+            size_t common = 0;
+            if (!first) {
+                size_t limit = min(pattern.size(), previous.size()) - depth;
+                limit = min(limit, path.size() - 1);
+                while (common < limit && fold(pattern[depth + common]) == fold(previous[depth + common])) {
+                    ++common;
+                }
+            }
+            path.resize(common + 1);
+
+            TrieNode* node = path.back();
+            for (size_t i = depth + common; i < pattern.size(); ++i) {
+                auto it = node->children.try_emplace(node->children.end(), fold(pattern[i]), nullptr);
+                if (it->second == nullptr) {
+                    it->second = new TrieNode();
+                    ++added.nodes;
+                }
+                node = it->second;
+                path.push_back(node);
+            }
+            if (node->patternIndices.empty()) {
+                ++added.outputNodes;
+            }
+            node->patternIndices.push_back(patternIndex);
+            added.addPattern(storePatterns ? storedPattern(patternIndex).size() : 0);
+            previous = pattern;
+            first = false;
+        }
+    }
+
+    // Read-only twin of insertSorted(): what inserting order[*] below `base` would
+    // add. `base` may be null when that subtree does not exist yet. Exact only
+    // for sorted `order`, where equal keys are adjacent.
+    Footprint measureSorted(const vector<int>& order, size_t depth, const TrieNode* base) const {
+        Footprint added;
+        string_view previous;
+        bool first = true;
+
+        for (int patternIndex : order) {
+            string_view pattern = key(patternIndex);
+            size_t length = pattern.size() - depth;
+            size_t common = 0;
+            if (!first) {
+                size_t limit = min(pattern.size(), previous.size()) - depth;
+                while (common < limit && fold(pattern[depth + common]) == fold(previous[depth + common])) {
+                    ++common;
+                }
+            }
+
+            // Nodes already in the trie before this insertion started.
+            const TrieNode* node = base;
+            size_t existing = 0;
+            while (node != nullptr && existing < length) {
+                auto it = node->children.find(fold(pattern[depth + existing]));
+                if (it == node->children.end()) {
+                    break;
+                }
+                node = it->second;
+                ++existing;
+            }
+
+            added.nodes += length - max(common, existing);
+            bool sameAsPrevious = !first && common == length && previous.size() == pattern.size();
+            bool hadOutputs = node != nullptr && existing == length && !node->patternIndices.empty();
+            if (!sameAsPrevious && !hadOutputs) {
+                ++added.outputNodes;
+            }
+            added.addPattern(storePatterns ? storedPattern(patternIndex).size() : 0);
+            previous = pattern;
+            first = false;
+        }
+        return added;
+    }
+
+    // Drops patterns [count, registeredCount()) that were registered but not
+    // inserted, and hands back the memory the arrays grew into for them.
+    void truncatePatterns(size_t count) {
+        patternOffsets.resize(count - arenaBase + 1);
+        patternArena.resize(patternOffsets.back());
+        patternAnchors.resize(count);
+        patternPayloads.resize(count);
+        patternLengths.resize(count);
+        patternOffsets.shrink_to_fit();
+        patternArena.shrink_to_fit();
+        patternAnchors.shrink_to_fit();
+        patternPayloads.shrink_to_fit();
+        patternLengths.shrink_to_fit();
+    }
+
+    // Sets the failure and output links of `child`, reached from `parent` by `transitionChar`.
+    // Only reads nodes that are shallower than `child`.
+    void linkChild(const TrieNode* parent, char transitionChar, TrieNode* child) const {
+        TrieNode* tempFailureNode = parent->failureLink;
+        while (tempFailureNode != root && tempFailureNode->children.find(transitionChar) == tempFailureNode->children.end()) {
+            tempFailureNode = tempFailureNode->failureLink;
+        }
+        auto it = tempFailureNode->children.find(transitionChar);
+        if (it != tempFailureNode->children.end()) {
+            child->failureLink = it->second;
+        } else {
+            child->failureLink = root;
+        }
+
+        TrieNode* failNode = child->failureLink;
+        if (!failNode->patternIndices.empty()) {
+            child->outputLink = failNode;
+        } else {
+            child->outputLink = failNode->outputLink;
+        }
+    }
+
+    // Level-synchronous BFS: every node of one depth is linked before the next depth starts.
+    void buildFailureLinksParallel(unsigned numThreads) {
+        vector<TrieNode*> level;
+        for (auto const& [key, val] : root->children) {
+            val->failureLink = root;
+            val->outputLink = nullptr;
+            level.push_back(val);
+        }
+
+        while (!level.empty()) {
+            // Each node writes its children into its own slice of the next level.
+            vector<size_t> offsets(level.size() + 1, 0);
+            for (size_t i = 0; i < level.size(); ++i) {
+                offsets[i + 1] = offsets[i] + level[i]->children.size();
+            }
+
+            vector<TrieNode*> next(offsets.back());
+            parallelFor(level.size(), numThreads, [&](size_t i) {
+                TrieNode* currentNode = level[i];
+                size_t out = offsets[i];
+                for (auto const& [key, val] : currentNode->children) {
+                    linkChild(currentNode, key, val);
+                    next[out++] = val;
+                }
+            });
+            level.swap(next);
+        }
+    }
+
+    // Follows the goto/failure transitions of `node` for one (folded) byte.
+    const TrieNode* step(const TrieNode* node, char ch) const {
+        while (node != root && node->children.find(ch) == node->children.end()) {
+            node = node->failureLink;
+        }
+        auto it = node->children.find(ch);
+        if (it != node->children.end()) {
+            node = it->second;
+        }
+        return node;
+    }
+
+    // The chunk being scanned, with its offset in the stream.
+    struct Chunk {
+        const char* data;
+        size_t size;
+        size_t base;
+    };
+
+    // The byte at stream offset `position`, which lies in the chunk or in the
+    // state's history; -1 before the start of the stream.
+    static int byteAt(const ScanState& state, const Chunk& chunk, size_t position) {
+        if (position >= chunk.base) {
+            return static_cast<unsigned char>(chunk.data[position - chunk.base]);
+        }
+        size_t back = chunk.base - position;
+        if (back > state.history.size()) {
+            return -1;
+        }
+        return static_cast<unsigned char>(state.history[state.history.size() - back]);
+    }
+
+    // Reports every pattern ending at `node`, following its output links.
+    // startOf(patternIndex) gives the stream offset where a candidate starts.
+    // Anchored patterns are only reported if their anchors hold around that
+    // span; if the byte after the span is not in this chunk yet, the match is
+    // parked in the state until the next chunk or finishScan() decides it.
+    template <typename StartOf, typename Callback>
+    void collectMatches(const TrieNode* node, ScanState& state, const Chunk& chunk, size_t endPosition,
+                        const StartOf& startOf, Callback& onMatch) const {
+        const TrieNode* outputNode = node;
+        while (outputNode != nullptr) {
+            for (int patternIndex : outputNode->patternIndices) {
+                Match match{patternIndex, startOf(patternIndex), endPosition, patternPayloads[patternIndex]};
+                uint8_t anchors = patternAnchors[patternIndex];
+                if (anchors != AnchorNone) {
+                    int before = match.startPosition == 0 ? -1 : byteAt(state, chunk, match.startPosition - 1);
+                    if (!startAnchorsHold(anchors, before)) {
+                        continue;
+                    }
+                    if (anchors & kLookaheadAnchors) {
+                        size_t next = endPosition + 1;
+                        if (next >= chunk.base + chunk.size) {
+                            state.pending.push_back(match);
+                            continue;
+                        }
+                        if (!endAnchorsHold(anchors, byteAt(state, chunk, next))) {
+                            continue;
+                        }
+                    }
+                }
+                onMatch(match);
+            }
+            outputNode = outputNode->outputLink;
+        }
+    }
+
+    // Reports the parked matches whose following byte is now known (-1: end of input).
+    template <typename Callback>
+    void resolvePending(ScanState& state, int after, Callback& onMatch) const {
+        for (const Match& match : state.pending) {
+            if (endAnchorsHold(patternAnchors[match.patternIndex], after)) {
+                onMatch(match);
+            }
+        }
+        state.pending.clear();
+    }
+
+    // Keeps the tail of the stream that lookbehind checks may still need.
+    void updateHistory(ScanState& state, const Chunk& chunk) const {
+        if (!hasAnchors) {
+            return;
+        }
+        // A folded byte comes from at most 4 source bytes, plus the byte before the match.
+        size_t keep = (unicodeFolding() ? 4 : 1) * maxKeyLength + 1;
+        if (chunk.size >= keep) {
+            state.history.assign(chunk.data + chunk.size - keep, keep);
+        } else {
+            state.history.append(chunk.data, chunk.size);
+            if (state.history.size() > keep) {
+                state.history.erase(0, state.history.size() - keep);
+            }
+        }
+    }
+
+    // Records the length of a newly added pattern's trie key.
+    void recordKeyLength(int patternIndex, size_t length) {
+        patternLengths[patternIndex] = length;
+        maxKeyLength = max(maxKeyLength, length);
+    }
+
+    // Byte modes: one table load and one goto/failure step per byte.
+    template <typename Callback>
+    void scanBytes(ScanState& state, const Chunk& chunk, Callback& onMatch) const {
+        const TrieNode* currentNode = state.node;
+        for (size_t i = 0; i < chunk.size; ++i) {
+            currentNode = step(currentNode, fold(chunk.data[i]));
+            size_t endPosition = chunk.base + i;
+            collectMatches(currentNode, state, chunk, endPosition, [this, endPosition](int patternIndex) {
+                return endPosition + 1 - patternLengths[patternIndex];
+            }, onMatch);
+        }
+        state.node = currentNode;
+    }
+
+    /**
+     * Unicode modes: decodes, folds and feeds the code points of segment[0..size),
+     * which starts at stream offset `base`, to the automaton as UTF-8. Unless
+     * `final`, an incomplete sequence at the end is left unconsumed.
+     *
+     * @return The number of segment bytes consumed.
+     */
+    template <typename Callback>
+    size_t scanUnicodeSegment(ScanState& state, const Chunk& chunk, const char* segment, size_t size,
+                              size_t base, bool final, Callback& onMatch) const {
+        bool compat = caseFolding == CaseFolding::UnicodeCompat;
+        size_t mask = state.sourceOffsets.size() - 1;
+        auto startOf = [this, &state, mask](int patternIndex) -> size_t {
+            size_t length = patternLengths[patternIndex];
+            if (length == 0) {
+                return state.sourceOffsets[(state.foldedCount - 1) & mask] + 1;
+            }
+            return state.sourceOffsets[(state.foldedCount - length) & mask];
+        };
+        auto feed = [&](char ch, size_t start, size_t endPosition, auto& report) {
+            state.sourceOffsets[state.foldedCount++ & mask] = start;
+            state.node = step(state.node, ch);
+            collectMatches(state.node, state, chunk, endPosition, startOf, report);
+        };
+        auto sameMatch = [](const Match& a, const Match& b) {
+            return a.patternIndex == b.patternIndex && a.startPosition == b.startPosition;
+        };
+
+        string encoded;
+        vector<Match> reported; // Matches of the code point being fed
+        size_t i = 0;
+        while (i < size) {
+            char32_t cp;
+            size_t length = decodeUtf8(segment + i, size - i, cp);
+            if (length == 0) {
+                if (!final && isTruncatedUtf8(segment + i, size - i)) {
+                    break;
+                }
+                feed(segment[i], base + i, base + i, onMatch);
+                ++i;
+                continue;
+            }
+
+            size_t start = base + i;
+            size_t endPosition = start + length - 1;
+            if (cp < 0x80 && !compat) {
+                feed(static_cast<char>(cp >= 'A' && cp <= 'Z' ? cp + 0x20 : cp), start, endPosition, onMatch);
+            } else {
+                char32_t folded[kMaxFoldedCodepoints];
+                int count = foldCodepoint(cp, compat, folded);
+                encoded.clear();
+                for (int k = 0; k < count; ++k) {
+                    encodeUtf8(folded[k], encoded);
+                }
+                // Every byte of the code point maps back to the same span, so
+                // a match can complete more than once within it (pattern "s"
+                // in text "\u00df", folded "ss"): report each one once.
+                reported.clear();
+                auto reportOnce = [&](const Match& match) {
+                    for (const Match& earlier : reported) {
+                        if (sameMatch(earlier, match)) {
+                            return;
+                        }
+                    }
+                    reported.push_back(match);
+                    onMatch(match);
+                };
+                size_t pendingBefore = state.pending.size();
+                for (char ch : encoded) {
+                    feed(ch, start, endPosition, reportOnce);
+                }
+                for (size_t k = pendingBefore; k < state.pending.size();) {
+                    auto earlier = state.pending.begin() + pendingBefore;
+                    if (any_of(earlier, state.pending.begin() + k,
+                               [&](const Match& m) { return sameMatch(m, state.pending[k]); })) {
+                        state.pending.erase(state.pending.begin() + k);
+                    } else {
+                        ++k;
+                    }
+                }
+            }
+            i += length;
+        }
+        return i;
+    }
+
+    template <typename Callback>
+    void scanUnicode(ScanState& state, const Chunk& chunk, Callback& onMatch) const {
+        if (state.sourceOffsets.empty()) {
+            size_t ringSize = 1;
+            while (ringSize <= maxKeyLength) {
+                ringSize <<= 1;
+            }
+            state.sourceOffsets.assign(ringSize, 0);
+        }
+
+        // First finish a code point split across the previous chunk boundary.
+        size_t skip = 0;
+        if (!state.partial.empty()) {
+            size_t carried = state.partial.size();
+            string joined = state.partial;
+            joined.append(chunk.data, min<size_t>(chunk.size, 4));
+            size_t consumed = scanUnicodeSegment(state, chunk, joined.data(), joined.size(),
+                                                 chunk.base - carried, false, onMatch);
+            if (consumed < carried) {
+                state.partial = joined; // Still incomplete: the whole chunk was a fragment
+                return;
+            }
+            skip = consumed - carried;
+            state.partial.clear();
+        }
+
+        size_t consumed = scanUnicodeSegment(state, chunk, chunk.data + skip, chunk.size - skip,
+                                             chunk.base + skip, false, onMatch);
+        state.partial.assign(chunk.data + skip + consumed, chunk.size - skip - consumed);
+    }
+
+public:
+    explicit AhoCorasick(const AhoCorasickOptions& options = AhoCorasickOptions())
+        : storePatterns(options.patternStorage == PatternStorage::Arena),
+          deduplicate(options.deduplicate),
+          keepDuplicateIds(options.deduplicate && options.keepDuplicateIds),
+          memoryBudget(options.memoryBudget),
+          caseFolding(options.caseFolding) {
+        root = new TrieNode();
+        footprint.nodes = 1;
+        root->failureLink = root; // Root's failure link points to itself
+
+        for (int b = 0; b < 256; ++b) {
+            foldTable[b] = static_cast<char>(b);
+        }
+        if (options.caseFolding == CaseFolding::Ascii) {
+            for (int b = 'A'; b <= 'Z'; ++b) {
+                foldTable[b] = static_cast<char>(b - 'A' + 'a');
+            }
+        }
+    }
+
+    /**
+     * @brief Builds a ready-to-search automaton from a whole pattern list.
+     *
+     * The patterns are sorted and inserted in one linear pass: each pattern
+     * reuses the trie path it shares with its predecessor instead of descending
+     * from the root. Pattern indices follow the order of `initialPatterns`.
+     *
+     * @param initialPatterns The patterns to be added.
+     * @param presorted Skip sorting because `initialPatterns` is already in
+     *        lexicographic order. This is checked in O(m); input that is not
+     *        sorted is sorted anyway.
+     * @param options Build options, e.g. case folding. With deduplication,
+     *        duplicates are reported under the earliest one's index, while
+     *        every pattern keeps its input position as index. If the patterns
+     *        do not fit the memory budget the automaton is left empty and
+     *        budgetExceeded() returns true.
+     *
+     * @note Time Complexity: O(m + k log k) string comparisons to sort, where m is
+     *       the total length of the k patterns; O(m) when presorted.
+     */
+    explicit AhoCorasick(const vector<string>& initialPatterns, bool presorted = false,
+                         const AhoCorasickOptions& options = AhoCorasickOptions())
+        : AhoCorasick(options) {
+        for (const string& pattern : initialPatterns) {
+            appendToArena(pattern);
+        }
+        prepareKeys(0);
+        vector<int> order(patternCount());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        // Input claimed to be sorted is checked, as both duplicate merging and
+        // the budget check rely on equal keys being adjacent.
+        auto less = [this](int x, int y) { return foldedLess(x, y); };
+        if (!presorted || !is_sorted(order.begin(), order.end(), less)) {
+            stable_sort(order.begin(), order.end(), less);
+        }
+        addCount = patternCount();
+        Footprint duplicates;
+        if (deduplicate) {
+            duplicates = mergeSortedDuplicates(order);
+        }
+        Footprint added = measureSorted(order, 0, root);
+        added.add(duplicates);
+        if (exceedsBudget(added, 0)) {
+            // Leave a valid, empty automaton behind; see budgetExceeded().
+            overBudget = true;
+            truncatePatterns(0);
+            vector<vector<int>>().swap(duplicateIds);
+            addCount = 0;
+            order.clear();
+        }
+        insertSorted(order, 0, root, footprint);
+        if (!overBudget) {
+            footprint.add(duplicates);
+        }
+        releaseKeys();
+        dropInsertedStrings();
+        buildFailureLinks();
+    }
+
+    ~AhoCorasick() {
+        deleteTrie(root);
+    }
+
+    // The automaton owns its trie through raw pointers, so it is not copyable.
+    AhoCorasick(const AhoCorasick&) = delete;
+    AhoCorasick& operator=(const AhoCorasick&) = delete;
+
+    /**
+     * @brief Adds a pattern to the Aho-Corasick automaton.
+     * 
+     * This function adds the given pattern to the trie. It traverses the trie
+     * according to the characters in the pattern, creating new nodes if necessary.
+     * With case folding enabled the characters are folded before insertion, while
+     * getPattern() still returns the pattern as given.
+     * @param pattern The pattern to be added.
+     * @param anchors Anchor flags the match must satisfy, e.g. AnchorWord to
+     *        only report the pattern as a whole word.
+     * @param payload Opaque caller data (e.g. a packed rule id, severity and
+     *        category) returned with every match of this pattern.
+     * @return The pattern's index. With deduplication enabled, adding a pattern
+     *         equal to an earlier one (after folding, with the same anchors)
+     *         returns the earlier pattern's index. Returns -1, leaving the
+     *         automaton unchanged, if the pattern would exceed the memory budget.
+     * 
+     * @note Time Complexity: O(p), where p is the length of the pattern.
+     * @note Space Complexity: O(p), in the worst case where the pattern does not
+     *       share any prefix with the existing patterns.
+     */
+    int addPattern(const string& pattern, uint8_t anchors = AnchorNone, uint64_t payload = 0) {
+        string folded;
+        if (unicodeFolding()) {
+            folded = foldUtf8(pattern, caseFolding == CaseFolding::UnicodeCompat);
+        }
+        const string& patternKey = unicodeFolding() ? folded : pattern;
+
+        // Walk the part of the key that is already in the trie.
+        TrieNode* node = root;
+        size_t existing = 0;
+        while (existing < patternKey.size()) {
+            auto it = node->children.find(fold(patternKey[existing]));
+            if (it == node->children.end()) {
+                break;
+            }
+            node = it->second;
+            ++existing;
+        }
+
+        if (deduplicate && existing == patternKey.size()) {
+            for (int duplicate : node->patternIndices) {
+                if (patternAnchors[duplicate] == anchors) {
+                    // Only the caller id grows, and only if ids are kept.
+                    if (exceedsBudget(Footprint(), 1)) {
+                        overBudget = true;
+                        return -1;
+                    }
+                    noteDuplicateId(duplicate, addCount++);
+                    return duplicate;
+                }
+            }
+        }
+
+        Footprint added;
+        added.nodes = patternKey.size() - existing;
+        added.outputNodes = (added.nodes == 0 && !node->patternIndices.empty()) ? 0 : 1;
+        added.addPattern(storePatterns ? pattern.size() : 0);
+        if (exceedsBudget(added, 1)) {
+            overBudget = true;
+            return -1;
+        }
+
+        int callerId = addCount++;
+        TrieNode* terminal = insertPath(node, patternKey, existing);
+        if (terminal->patternIndices.empty()) {
+            ++footprint.outputNodes;
+        }
+        footprint.addPattern(storePatterns ? pattern.size() : 0);
+
+        int patternIndex = patternCount();
+        if (storePatterns) {
+            appendToArena(pattern);
+        } else {
+            arenaBase = patternIndex + 1;
+        }
+        patternAnchors.push_back(anchors);
+        hasAnchors = hasAnchors || anchors != AnchorNone;
+        patternPayloads.push_back(payload);
+        patternLengths.push_back(0);
+        recordKeyLength(patternIndex, patternKey.size());
+        terminal->patternIndices.push_back(patternIndex);
+        noteDuplicateId(patternIndex, callerId);
+        return patternIndex;
+    }
+
+    /**
+     * @brief Adds many patterns at once, inserting them across several threads.
+     *
+     * Patterns are bucketed by their first character, and buckets too large
+     * to balance the threads are split further by the characters that follow;
+     * every bucket owns a disjoint subtree, so buckets are sorted and inserted
+     * by worker threads independently. Pattern indices are assigned in input
+     * order, exactly as if addPattern() had been called for each pattern.
+     * With deduplication enabled the patterns are added one by one instead, so
+     * duplicates of earlier patterns resolve to their canonical index.
+     *
+     * @return false, leaving the automaton unchanged, if the patterns would
+     *         exceed the memory budget (with deduplication: if any was rejected).
+     *
+     * @param newPatterns The patterns to be added, all unanchored with a zero payload.
+     * @param numThreads The number of threads to use; 0 or 1 inserts serially.
+     *
+     * @note Time Complexity: O(m log k / t) for t threads, where m is the total
+     *       length of the new patterns and k the number of patterns per bucket.
+     */
+    bool addPatterns(const vector<string>& newPatterns, unsigned numThreads) {
+        if (deduplicate) {
+            bool allAdded = true;
+            for (const string& pattern : newPatterns) {
+                allAdded = addPattern(pattern) >= 0 && allAdded;
+            }
+            return allAdded;
+        }
+
+        int firstIndex = patternCount();
+        for (const string& pattern : newPatterns) {
+            appendToArena(pattern);
+        }
+        prepareKeys(firstIndex);
+
+        // Buckets own disjoint subtrees: patterns are grouped by their first byte,
+        // and a bucket larger than a share of the work is split again by its
+        // next byte, so a skewed dictionary (say, URLs all starting with
+        // "http") still spreads across the threads. Patterns whose whole key
+        // is a split prefix end at that prefix's node and are added serially.
+        struct Bucket {
+            string prefix; // Folded key bytes shared by the patterns
+            vector<int> patterns;
+        };
+        size_t splitAbove = numThreads > 1 ? max(kMinSplitBucket, newPatterns.size() / (4 * numThreads))
+                                           : numeric_limits<size_t>::max();
+        vector<Bucket> buckets;
+        vector<Bucket> endings;
+        vector<Bucket> toSplit(1);
+        for (size_t i = 0; i < newPatterns.size(); ++i) {
+            toSplit[0].patterns.push_back(firstIndex + i);
+        }
+        while (!toSplit.empty()) {
+            Bucket bucket = move(toSplit.back());
+            toSplit.pop_back();
+            size_t depth = bucket.prefix.size();
+            if (depth > 0 && bucket.patterns.size() <= splitAbove) {
+                buckets.push_back(move(bucket));
+                continue;
+            }
+            vector<vector<int>> children(256);
+            Bucket ending{bucket.prefix, {}};
+            for (int patternIndex : bucket.patterns) {
+                string_view patternKey = key(patternIndex);
+                if (patternKey.size() == depth) {
+                    ending.patterns.push_back(patternIndex);
+                } else {
+                    children[static_cast<unsigned char>(fold(patternKey[depth]))].push_back(patternIndex);
+                }
+            }
+            if (!ending.patterns.empty()) {
+                endings.push_back(move(ending));
+            }
+            for (int b = 0; b < 256; ++b) {
+                if (!children[b].empty()) {
+                    toSplit.push_back({bucket.prefix + static_cast<char>(b), move(children[b])});
+                }
+            }
+        }
+
+        auto nodeAt = [this](const string& prefix) -> TrieNode* {
+            TrieNode* node = root;
+            for (size_t i = 0; i < prefix.size() && node != nullptr; ++i) {
+                auto it = node->children.find(prefix[i]);
+                node = it == node->children.end() ? nullptr : it->second;
+            }
+            return node;
+        };
+
+        vector<Footprint> bucketFootprints(buckets.size());
+        parallelFor(buckets.size(), numThreads, [&](size_t i) {
+            vector<int>& bucket = buckets[i].patterns;
+            stable_sort(bucket.begin(), bucket.end(), [this](int x, int y) {
+                return foldedLess(x, y);
+            });
+            if (memoryBudget != 0) {
+                bucketFootprints[i] = measureSorted(bucket, buckets[i].prefix.size(), nodeAt(buckets[i].prefix));
+            }
+        }, 1);
+
+        if (memoryBudget != 0) {
+            Footprint added;
+            for (const Footprint& bucketFootprint : bucketFootprints) {
+                added.add(bucketFootprint);
+            }
+            // The nodes on the prefix paths, counted once each: in sorted order
+            // a prefix only adds the nodes past the one it shares with its
+            // predecessor and past those already in the trie.
+            vector<string> prefixes;
+            for (const vector<Bucket>* group : {&buckets, &endings}) {
+                for (const Bucket& bucket : *group) {
+                    prefixes.push_back(bucket.prefix);
+                }
+            }
+            sort(prefixes.begin(), prefixes.end());
+            for (size_t k = 0; k < prefixes.size(); ++k) {
+                const string& prefix = prefixes[k];
+                size_t common = 0;
+                if (k > 0) {
+                    const string& previous = prefixes[k - 1];
+                    while (common < min(prefix.size(), previous.size()) && prefix[common] == previous[common]) {
+                        ++common;
+                    }
+                }
+                const TrieNode* node = root;
+                size_t existing = 0;
+                while (existing < prefix.size()) {
+                    auto it = node->children.find(prefix[existing]);
+                    if (it == node->children.end()) {
+                        break;
+                    }
+                    node = it->second;
+                    ++existing;
+                }
+                added.nodes += prefix.size() - max(common, existing);
+            }
+            for (const Bucket& ending : endings) {
+                const TrieNode* node = nodeAt(ending.prefix);
+                added.outputNodes += node == nullptr || node->patternIndices.empty() ? 1 : 0;
+                for (int patternIndex : ending.patterns) {
+                    added.addPattern(storePatterns ? storedPattern(patternIndex).size() : 0);
+                }
+            }
+            if (exceedsBudget(added, 0)) {
+                overBudget = true;
+                truncatePatterns(firstIndex);
+                releaseKeys();
+                dropInsertedStrings();
+                return false;
+            }
+        }
+
+        addCount += newPatterns.size();
+        for (const Bucket& ending : endings) {
+            TrieNode* node = insertPath(root, ending.prefix, 0);
+            if (node->patternIndices.empty()) {
+                ++footprint.outputNodes;
+            }
+            for (int patternIndex : ending.patterns) {
+                node->patternIndices.push_back(patternIndex);
+                footprint.addPattern(storePatterns ? storedPattern(patternIndex).size() : 0);
+            }
+        }
+
+        // Bucket roots are created up front so workers never touch a shared map.
+        vector<TrieNode*> bases(buckets.size());
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            bases[i] = insertPath(root, buckets[i].prefix, 0);
+        }
+
+        parallelFor(buckets.size(), numThreads, [&](size_t i) {
+            bucketFootprints[i] = Footprint();
+            insertSorted(buckets[i].patterns, buckets[i].prefix.size(), bases[i], bucketFootprints[i]);
+        }, 1);
+        for (const Footprint& added : bucketFootprints) {
+            footprint.add(added);
+        }
+        releaseKeys();
+        dropInsertedStrings();
+        return true;
+    }
+
+    /**
+     * @brief Builds the failure links and output links for the Aho-Corasick automaton.
+     * 
+     * The function uses a breadth-first search (BFS) to traverse the trie and set
+     * the failure and output links for each node.
+     *
+     * @param numThreads The number of threads to use. With more than one thread
+     *        the BFS is level-synchronous: a node's failure link only depends on
+     *        strictly shallower nodes, so each depth level is split across threads
+     *        once the previous level is complete.
+     * 
+     * @note Time Complexity: O(m), where m is the total number of characters in all
+     *       patterns.
+     * @note Space Complexity: O(m), mainly for storing the nodes of the Trie. The
+     *       queue used for BFS has a maximum size of the number of nodes.
+     */
+    void buildFailureLinks(unsigned numThreads = 1) {
+        if (numThreads > 1) {
+            buildFailureLinksParallel(numThreads);
+            return;
+        }
+
+        queue<TrieNode*> q;
+
+        for (auto const& [key, val] : root->children) {
+            TrieNode* childNode = val;
+            childNode->failureLink = root;
+             childNode->outputLink = nullptr;
+            q.push(childNode);
+        }
+
+        while (!q.empty()) {
+            TrieNode* currentNode = q.front();
+            q.pop();
+
+            for (auto const& [key, val] : currentNode->children) {
+                linkChild(currentNode, key, val);
+                q.push(val);
+            }
+        }
+    }
+
+    /**
+     * @brief Searches for all patterns in the given text using the Aho-Corasick algorithm.
+     * 
+     * This function traverses the text character by character. For each character,
+     * it follows the transitions in the Aho-Corasick automaton. If it reaches a
+     * node that corresponds to the end of one or more patterns, it records the
+     * pattern index and the ending position of the match in the text.
+     * 
+     * @param text The text to search within.
+     * @return A vector of pairs. Each pair contains the index of a found pattern
+     *         and the ending position (index in the text) where the pattern ends.
+     *         searchMatches() also reports the starting position of each match.
+     *         In the Unicode folding modes the ending position is the last byte
+     *         of the code point that completed the match.
+     * 
+     * @note Time Complexity: O(n + z), where n is the length of the text, 
+     *       and z is the number of matches found.
+     * @note Space Complexity: O(m), where m is the total length of all patterns.
+     * @note search() does not modify the automaton, so once buildFailureLinks()
+     *       has run any number of threads may search the same instance.
+     */
+    vector<pair<int, int>> search(const string& text) const {
+        vector<pair<int, int>> matches;
+        search(text, [&matches](const Match& match) {
+            matches.push_back({match.patternIndex, static_cast<int>(match.endPosition)});
+        });
+        return matches;
+    }
+
+    /**
+     * @brief Searches the text and returns every match with its full span.
+     *
+     * Each Match carries the start offset, computed inside the scan from the
+     * per-pattern length array, so redaction or highlighting needs no
+     * getPattern() lookups.
+     *
+     * @param text The text to search within.
+     * @return The matches in order of their end position.
+     */
+    vector<Match> searchMatches(const string& text) const {
+        vector<Match> matches;
+        search(text, [&matches](const Match& match) {
+            matches.push_back(match);
+        });
+        return matches;
+    }
+
+    /**
+     * @brief Searches the text and hands every match to a callback.
+     *
+     * Same scan as search(text), but nothing is materialized: each match is
+     * passed to `onMatch` as soon as it is found, together with the payload
+     * stored for its pattern, so callers need no side table keyed by index.
+     *
+     * @param text The text to search within.
+     * @param onMatch Callable invoked as onMatch(const Match&) for every match.
+     */
+    template <typename Callback>
+    void search(const string& text, Callback&& onMatch) const {
+        ScanState state;
+        scanChunk(state, text.data(), text.size(), onMatch);
+        finishScan(state, onMatch);
+    }
+
+    /**
+     * @brief Scans the next chunk of a stream, resuming from `state`.
+     *
+     * Splitting a text into chunks finds exactly the matches search() finds on
+     * the whole text, with positions counted from the start of the stream.
+     * Matches that span chunk boundaries are found; anchored matches that need
+     * the byte after the chunk are reported by the next call or finishScan().
+     *
+     * @param state The stream's scan state.
+     * @param data The chunk's bytes; they need not outlive the call.
+     * @param size The number of bytes in the chunk.
+     * @param onMatch Callable invoked as onMatch(const Match&) for every match.
+     */
+    template <typename Callback>
+    void scanChunk(ScanState& state, const char* data, size_t size, Callback&& onMatch) const {
+        if (size == 0) {
+            return;
+        }
+        if (state.node == nullptr) {
+            state.node = root;
+        }
+        if (!state.pending.empty()) {
+            resolvePending(state, static_cast<unsigned char>(data[0]), onMatch);
+        }
+
+        Chunk chunk{data, size, state.offset};
+        if (unicodeFolding()) {
+            scanUnicode(state, chunk, onMatch);
+        } else {
+            scanBytes(state, chunk, onMatch);
+        }
+        updateHistory(state, chunk);
+        state.offset += size;
+    }
+
+    /**
+     * @brief Ends the stream scanned through `state`.
+     *
+     * Reports the matches that were waiting for the end of the input and resets
+     * the state so it can scan another stream.
+     */
+    template <typename Callback>
+    void finishScan(ScanState& state, Callback&& onMatch) const {
+        if (!state.partial.empty()) {
+            // An incomplete UTF-8 sequence at the very end: scan it as raw bytes.
+            string tail;
+            tail.swap(state.partial);
+            Chunk chunk{tail.data(), tail.size(), state.offset - tail.size()};
+            if (state.node == nullptr) {
+                state.node = root;
+            }
+            scanUnicodeSegment(state, chunk, tail.data(), tail.size(), chunk.base, true, onMatch);
+        }
+        resolvePending(state, -1, onMatch);
+        state = ScanState();
+    }
+
+    /**
+     * @brief Retrieves the pattern at the specified index.
+     * 
+     * This function returns a view of the pattern stored at the given index in
+     * the pattern arena. If the index is out of bounds, or the pattern strings
+     * are not kept (PatternStorage::LengthsOnly, releasePatterns()), it returns
+     * an empty view.
+     * 
+     * @param index The index of the pattern to retrieve.
+     * @return A view of the pattern at the specified index, valid until the next
+     *         pattern is added, or an empty view if the pattern is unavailable.
+     * @note The view points into the arena, which addPattern(), addPatterns()
+     *       and releasePatterns() may reallocate or free; it then dangles.
+     *       Copy it into a string to keep it across those calls.
+     */
+    string_view getPattern(int index) const {
+        if (index >= static_cast<int>(arenaBase) && index < static_cast<int>(patternCount())) {
+            return storedPattern(index);
+        }
+        return string_view();
+    }
+
+    /**
+     * @brief Discards the stored pattern strings.
+     *
+     * Matching is unaffected since the automaton only needs the pattern lengths;
+     * afterwards getPattern() returns empty views and later patterns are not
+     * stored either, as with PatternStorage::LengthsOnly.
+     */
+    void releasePatterns() {
+        storePatterns = false;
+        dropInsertedStrings();
+        footprint.patternBytes = 0;
+    }
+
+    /**
+     * @brief Retrieves the payload stored with the pattern at the specified index.
+     *
+     * @return The payload given to addPattern(), or 0 if the index is invalid.
+     */
+    uint64_t getPayload(int index) const {
+        if (index >= 0 && index < static_cast<int>(patternPayloads.size())) {
+            return patternPayloads[index];
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Estimates the heap memory held by the automaton.
+     *
+     * The breakdown is derived from node, output and pattern counters maintained
+     * during insertion, using the typical sizes of the standard containers, so
+     * it costs O(1). The pattern-indexed arrays and the pattern arena count at
+     * their capacity.
+     *
+     * @return The estimated bytes per category; total() sums them.
+     */
+    MemoryUsage memoryUsage() const {
+        return usageOf(footprint, keepDuplicateIds ? addCount : 0);
+    }
+
+    // Whether an insertion was rejected because it would exceed the memory budget.
+    bool budgetExceeded() const {
+        return overBudget;
+    }
+
+    /**
+     * @brief Retrieves every caller id that was merged into a pattern index.
+     *
+     * Caller ids number the patterns in the order they were added, duplicates
+     * included. Only recorded when built with deduplicate and keepDuplicateIds.
+     *
+     * @return The caller ids in ascending order, or an empty list if the index
+     *         is invalid or ids are not kept.
+     */
+    const vector<int>& getDuplicateIds(int index) const {
+        if (index >= 0 && index < static_cast<int>(duplicateIds.size())) {
+            return duplicateIds[index];
+        }
+        static const vector<int> empty;
+        return empty;
+    }
+};
+
+/**
+ * @brief An Aho-Corasick automaton built entirely at compile time for a small
+ *        pattern set fixed in the source.
+ *
+ * Built with makeStaticAutomaton(), usually into a constexpr variable, so
+ * the complete transition table (failure links already folded in), output
+ * links and pattern lengths are constants in .rodata: nothing is allocated
+ * or initialized at run time, and search() is one table load per byte that
+ * the compiler can specialize and, for constant inputs, evaluate outright.
+ *
+ * @tparam States Upper bound on the number of states: 1 + total pattern length.
+ * @tparam Patterns The number of patterns.
+ * @note Table size is States * 256 * sizeof(State); meant for dozens of short
+ *       patterns, not large dictionaries.
+ */
+template <size_t States, size_t Patterns>
+class StaticAutomaton {
+public:
+    using State = conditional_t<(States <= 0xFFFF), uint16_t, uint32_t>;
+
+private:
+    State transitions[States][256] = {}; // Complete goto function: one row per state
+    State outputLink[States] = {};       // Nearest accepting proper suffix state; 0 (root) for none
+    int32_t firstPattern[States] = {};   // Lowest pattern index ending at the state, or -1
+    int32_t nextDuplicate[Patterns] = {}; // Next pattern index with the same key, or -1
+    size_t patternLengths[Patterns] = {};
+    size_t stateCount = 1;
+
+public:
+    /**
+     * @brief Builds the trie, then completes it into a DFA in BFS order.
+     *
+     * @param patterns Non-empty patterns; a pattern's index is its position.
+     * @note Time Complexity: O(States * 256), during compilation when constant-evaluated.
+     */
+    constexpr explicit StaticAutomaton(const string_view (&patterns)[Patterns]) {
+        for (size_t state = 0; state < States; ++state) {
+            firstPattern[state] = -1;
+        }
+
+        // While building the trie 0 means "no child": the root is nobody's child.
+        for (size_t p = 0; p < Patterns; ++p) {
+            State state = 0;
+            for (char ch : patterns[p]) {
+                unsigned char symbol = static_cast<unsigned char>(ch);
+                if (transitions[state][symbol] == 0) {
+                    transitions[state][symbol] = static_cast<State>(stateCount++);
+                }
+                state = transitions[state][symbol];
+            }
+            patternLengths[p] = patterns[p].size();
+            nextDuplicate[p] = -1;
+            if (firstPattern[state] < 0) {
+                firstPattern[state] = static_cast<int32_t>(p);
+            } else {
+                int32_t last = firstPattern[state];
+                while (nextDuplicate[last] >= 0) {
+                    last = nextDuplicate[last];
+                }
+                nextDuplicate[last] = static_cast<int32_t>(p);
+            }
+        }
+
+        // BFS: a state's failure target is shallower, so its row is complete
+        // by the time the state's own missing transitions copy from it.
+        State queue[States] = {};
+        State failure[States] = {};
+        size_t head = 0;
+        size_t tail = 0;
+        for (size_t symbol = 0; symbol < 256; ++symbol) {
+            if (transitions[0][symbol] != 0) {
+                queue[tail++] = transitions[0][symbol];
+            }
+        }
+        while (head < tail) {
+            State state = queue[head++];
+            State fail = failure[state];
+            outputLink[state] = firstPattern[fail] >= 0 ? fail : outputLink[fail];
+            for (size_t symbol = 0; symbol < 256; ++symbol) {
+                State child = transitions[state][symbol];
+                if (child != 0) {
+                    failure[child] = transitions[fail][symbol];
+                    queue[tail++] = child;
+                } else {
+                    transitions[state][symbol] = transitions[fail][symbol];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Reports every occurrence of every pattern in `text`, in the same
+     *        order AhoCorasick::search() would for the same pattern list.
+     *
+     * @param onMatch Callable invoked as onMatch(const Match&); payloads are 0.
+     *                A constexpr lambda keeps the whole call constant-evaluable.
+     */
+    template <typename Callback>
+    constexpr void search(string_view text, Callback&& onMatch) const {
+        State state = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            state = transitions[state][static_cast<unsigned char>(text[i])];
+            State accepting = firstPattern[state] >= 0 ? state : outputLink[state];
+            for (; accepting != 0; accepting = outputLink[accepting]) {
+                for (int32_t p = firstPattern[accepting]; p >= 0; p = nextDuplicate[p]) {
+                    onMatch(Match{p, i + 1 - patternLengths[p], i, 0});
+                }
+            }
+        }
+    }
+
+    // The number of matches search() would report.
+    constexpr size_t countMatches(string_view text) const {
+        size_t count = 0;
+        search(text, [&count](const Match&) { ++count; });
+        return count;
+    }
+
+    // Whether any pattern occurs in `text`; stops at the first match.
+    constexpr bool contains(string_view text) const {
+        State state = 0;
+        for (char ch : text) {
+            state = transitions[state][static_cast<unsigned char>(ch)];
+            if (firstPattern[state] >= 0 || outputLink[state] != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // States actually used; at most States.
+    constexpr size_t size() const {
+        return stateCount;
+    }
+};
+
+/**
+ * @brief Builds a StaticAutomaton from string literals, sized from their lengths.
+ *
+ * constexpr auto kFilter = makeStaticAutomaton("he", "she", "his", "hers");
+ * static_assert(kFilter.countMatches("ushers") == 3);
+ */
+template <size_t... N>
+constexpr auto makeStaticAutomaton(const char (&... patterns)[N]) {
+    static_assert(sizeof...(N) > 0, "at least one pattern is needed");
+    static_assert(((N > 1) && ...), "patterns must not be empty");
+    const string_view views[] = {string_view(patterns, N - 1)...};
+    return StaticAutomaton<1 + ((N - 1) + ...), sizeof...(N)>(views);
+}
+
+// Size of the huge pages HugePageArray asks for.
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+/**
+ * @brief A fixed-size owning array that can be backed by 2 MiB huge pages.
+ *
+ * With `hugePages`, memory is mapped from the hugetlbfs pool if the system
+ * has reserved one, otherwise as anonymous memory rounded up to whole huge
+ * pages and advised MADV_HUGEPAGE so transparent huge pages back it. A large
+ * table then needs one TLB entry per 2 MiB instead of per 4 KiB. Without the
+ * option, or if mapping fails, it is an ordinary heap array. Elements start
+ * zeroed.
+ */
+template <typename T>
+class HugePageArray {
+    static_assert(is_trivially_copyable<T>::value, "elements are zero-filled, not constructed");
+
+private:
+    T* items = nullptr;
+    size_t count = 0;
+    size_t mappedBytes = 0; // 0 if the items live on the heap
+
+    void release() {
+        if (mappedBytes != 0) {
+            munmap(items, mappedBytes);
+        } else {
+            delete[] items;
+        }
+        items = nullptr;
+        count = 0;
+        mappedBytes = 0;
+    }
+
+    // Maps `bytes` of anonymous memory at a huge-page boundary, which
+    // transparent huge pages need to back the whole range.
+    static void* mapAligned(size_t bytes) {
+        size_t padded = bytes + kHugePageSize;
+        void* mapping = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            return MAP_FAILED;
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+        uintptr_t aligned = (start + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+        if (aligned > start) {
+            munmap(mapping, aligned - start);
+        }
+        size_t tail = start + padded - (aligned + bytes);
+        if (tail > 0) {
+            munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+        }
+        return reinterpret_cast<void*>(aligned);
+    }
+
+public:
+    HugePageArray() = default;
+
+    HugePageArray(size_t count, bool hugePages) : count(count) {
+        size_t bytes = (count * sizeof(T) + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+        if (hugePages && bytes > 0) {
+            void* mapping = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+            if (mapping == MAP_FAILED) {
+                mapping = mapAligned(bytes);
+#ifdef MADV_HUGEPAGE
+                if (mapping != MAP_FAILED) {
+                    madvise(mapping, bytes, MADV_HUGEPAGE);
+                }
+#endif
+            }
+            if (mapping != MAP_FAILED) {
+                items = static_cast<T*>(mapping);
+                mappedBytes = bytes;
+                return;
+            }
+        }
+        items = new T[count]();
+    }
+
+    HugePageArray(HugePageArray&& other) noexcept
+        : items(other.items), count(other.count), mappedBytes(other.mappedBytes) {
+        other.items = nullptr;
+        other.count = 0;
+        other.mappedBytes = 0;
+    }
+
+    HugePageArray& operator=(HugePageArray&& other) noexcept {
+        if (this != &other) {
+            release();
+            swap(items, other.items);
+            swap(count, other.count);
+            swap(mappedBytes, other.mappedBytes);
+        }
+        return *this;
+    }
+
+    HugePageArray(const HugePageArray&) = delete;
+    HugePageArray& operator=(const HugePageArray&) = delete;
+
+    ~HugePageArray() {
+        release();
+    }
+
+    T* data() { return items; }
+    const T* data() const { return items; }
+    size_t size() const { return count; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+
+    // Whether the array is a huge-page mapping rather than a heap block.
+    bool mapped() const {
+        return mappedBytes != 0;
+    }
+};
+
+// Build options of CompiledAutomaton.
+struct CompiledOptions {
+    bool hugePages = false; // Back the transition table with 2 MiB pages (see HugePageArray)
+    // Merge equivalent states (see CompiledAutomaton::mergeEquivalentStates).
+    // Output is unchanged, but a minimized state only knows the lengths of
+    // its matches: each accepting step hashes and looks up the text once per
+    // distinct length, so it costs more the more lengths end there.
+    bool minimize = false;
+};
+
+/**
+ * @brief A run-time built dense-table Aho-Corasick automaton, templated on the
+ *        width of its state indices and on its symbol type.
+ *
+ * Unlike AhoCorasick, which walks map-based TrieNodes, the automaton is one
+ * transition table with failure links folded in. Symbols are mapped to
+ * dense classes first (the symbols that occur in patterns, plus one class
+ * for all others), so rows stay short even for 16- or 32-bit alphabets.
+ *
+ * The scan loop is kept free of per-symbol branches on the state: table
+ * entries hold the target state premultiplied by the row stride, so the
+ * next lookup needs no multiply, and states are numbered so that every
+ * state where a match ends comes after all others. Checking for a match is
+ * then one compare against a threshold, and the common non-matching step
+ * is one class load, one table load and one compare.
+ *
+ * With CompiledOptions::minimize, equivalent states are merged after the
+ * build (see mergeEquivalentStates), which shrinks the table of
+ * dictionaries whose patterns share long endings.
+ *
+ * @tparam StateT Unsigned state type, wide enough for states * stride.
+ *         uint16_t halves the table of a small dictionary compared with
+ *         uint32_t; a build that does not fit fails (see valid()).
+ * @tparam SymbolT Unsigned symbol type: uint8_t for bytes, uint16_t or uint32_t
+ *         for code units or token ids.
+ * @note Table size is states * (distinct pattern symbols + 1) * sizeof(StateT).
+ *       For large vocabularies with sparse use, see TokenAutomaton.
+ */
+template <typename StateT = uint32_t, typename SymbolT = uint8_t>
+class CompiledAutomaton {
+    static_assert(is_unsigned<StateT>::value && is_unsigned<SymbolT>::value,
+                  "state and symbol types must be unsigned integers");
+
+public:
+    using State = StateT;
+    using Symbol = SymbolT;
+
+private:
+    // Small alphabets map symbols through a table; wide ones by binary search.
+    static constexpr bool kDirectClasses = sizeof(SymbolT) <= 2;
+
+    vector<uint32_t> classOf;        // Symbol -> class, for kDirectClasses
+    vector<SymbolT> symbols;         // Sorted pattern symbols; class of symbols[k] is k + 1
+    size_t stride = 1;               // Classes per row, class 0 being "in no pattern"
+    HugePageArray<StateT> table;     // Row-major; entry state * stride + class holds next * stride
+    bool hugePages = false;
+    vector<StateT> outputLink;       // Nearest proper suffix state with outputs; 0 (root) for none
+    vector<uint32_t> outputBegin;    // CSR: patterns ending at state s are
+    vector<int> outputPatterns;      //   outputPatterns[outputBegin[s] .. outputBegin[s + 1])
+    vector<uint32_t> patternLengths;
+    size_t stateCount = 0;           // 0 if the build failed
+    size_t acceptThreshold = 0;      // Premultiplied id of the first state where matches end
+
+    // Once minimized, outputPatterns holds the pattern lengths reported at a
+    // state and matches are identified by looking their text up here.
+    bool minimized = false;
+    vector<SymbolT> patternSymbols;           // All patterns back to back
+    vector<size_t> patternOffsets;            // Pattern p starts at patternSymbols[patternOffsets[p]]
+    vector<pair<uint64_t, int>> patternHashes; // Sorted (hashSymbols(pattern), p), non-empty patterns only
+    size_t maxPatternLength = 0;
+
+    // Fills classOf from the sorted symbols.
+    void assignClasses() {
+        if constexpr (kDirectClasses) {
+            classOf.assign(size_t(1) << (8 * sizeof(SymbolT)), 0);
+            for (size_t k = 0; k < symbols.size(); ++k) {
+                classOf[symbols[k]] = static_cast<uint32_t>(k + 1);
+            }
+        }
+    }
+
+    uint32_t classFor(SymbolT symbol) const {
+        if constexpr (kDirectClasses) {
+            return classOf[symbol];
+        } else {
+            auto it = lower_bound(symbols.begin(), symbols.end(), symbol);
+            return it != symbols.end() && *it == symbol ? static_cast<uint32_t>(it - symbols.begin()) + 1 : 0;
+        }
+    }
+
+public:
+    /**
+     * @brief Builds the automaton; a pattern's index is its position. Empty
+     *        patterns never match.
+     *
+     * @note Time Complexity: O(L log L + states * stride), where L is the total pattern length.
+     */
+    explicit CompiledAutomaton(const vector<vector<SymbolT>>& patterns,
+                               const CompiledOptions& options = CompiledOptions())
+        : hugePages(options.hugePages) {
+        for (const vector<SymbolT>& pattern : patterns) {
+            symbols.insert(symbols.end(), pattern.begin(), pattern.end());
+        }
+        sort(symbols.begin(), symbols.end());
+        symbols.erase(unique(symbols.begin(), symbols.end()), symbols.end());
+        stride = symbols.size() + 1;
+        assignClasses();
+
+        // Trie in the table itself; 0 means "no child", as the root is nobody's child.
+        size_t maxStates = size_t(numeric_limits<StateT>::max()) + 1;
+        vector<StateT> trie(stride, 0);
+        size_t states = 1;
+        vector<int> endState(patterns.size());
+        for (size_t p = 0; p < patterns.size(); ++p) {
+            size_t state = 0;
+            for (SymbolT symbol : patterns[p]) {
+                size_t cell = state * stride + classFor(symbol);
+                if (trie[cell] == 0) {
+                    if (states == maxStates) {
+                        *this = CompiledAutomaton();
+                        return;
+                    }
+                    trie[cell] = static_cast<StateT>(states++);
+                    trie.resize(states * stride, 0);
+                }
+                state = trie[cell];
+            }
+            endState[p] = static_cast<int>(state);
+            patternLengths.push_back(static_cast<uint32_t>(patterns[p].size()));
+        }
+        stateCount = states;
+
+        // Output lists, patterns in index order within a state.
+        outputBegin.assign(states + 1, 0);
+        for (int state : endState) {
+            ++outputBegin[state + 1];
+        }
+        for (size_t state = 0; state < states; ++state) {
+            outputBegin[state + 1] += outputBegin[state];
+        }
+        outputPatterns.resize(patterns.size());
+        vector<uint32_t> fill(outputBegin.begin(), outputBegin.end() - 1);
+        for (size_t p = 0; p < patterns.size(); ++p) {
+            outputPatterns[fill[endState[p]]++] = static_cast<int>(p);
+        }
+
+        // Complete the goto function in BFS order, as StaticAutomaton does.
+        outputLink.assign(states, 0);
+        vector<StateT> failure(states, 0);
+        vector<StateT> queue;
+        queue.reserve(states);
+        for (size_t c = 0; c < stride; ++c) {
+            if (trie[c] != 0) {
+                queue.push_back(trie[c]);
+            }
+        }
+        for (size_t head = 0; head < queue.size(); ++head) {
+            StateT state = queue[head];
+            StateT fail = failure[state];
+            outputLink[state] = hasOwnOutputs(fail) ? fail : outputLink[fail];
+            StateT* row = &trie[size_t(state) * stride];
+            const StateT* failRow = &trie[size_t(fail) * stride];
+            for (size_t c = 0; c < stride; ++c) {
+                if (row[c] != 0) {
+                    failure[row[c]] = failRow[c];
+                    queue.push_back(row[c]);
+                } else {
+                    row[c] = failRow[c];
+                }
+            }
+        }
+
+        if ((states - 1) * stride > numeric_limits<StateT>::max()) {
+            *this = CompiledAutomaton();
+            return;
+        }
+        table = HugePageArray<StateT>(trie.size(), false);
+        for (size_t cell = 0; cell < trie.size(); ++cell) {
+            table[cell] = static_cast<StateT>(trie[cell] * stride);
+        }
+        trie = vector<StateT>();
+        queue.insert(queue.begin(), 0);
+        if (options.minimize) {
+            queue = mergeEquivalentStates(queue, patterns);
+        }
+        applyOrder(groupAccepting(queue));
+    }
+
+    CompiledAutomaton() = default;
+
+private:
+    bool hasOwnOutputs(size_t state) const {
+        return outputBegin[state] != outputBegin[state + 1];
+    }
+
+    // Whether some match ends in `state`: its own patterns or a suffix's.
+    bool accepting(size_t state) const {
+        return hasOwnOutputs(state) || outputLink[state] != 0;
+    }
+
+    static uint64_t hashSymbols(const SymbolT* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a over whole symbols
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Distinct lengths of the patterns reported in `state`, in report order.
+    vector<uint32_t> reportedLengths(size_t state) const {
+        vector<uint32_t> lengths;
+        size_t output = hasOwnOutputs(state) ? state : outputLink[state];
+        for (; output != 0; output = outputLink[output]) {
+            for (uint32_t k = outputBegin[output]; k < outputBegin[output + 1]; ++k) {
+                uint32_t length = patternLengths[outputPatterns[k]];
+                if (lengths.empty() || lengths.back() != length) {
+                    lengths.push_back(length);
+                }
+            }
+        }
+        return lengths;
+    }
+
+    /**
+     * @brief Merges states that report the same pattern lengths and whose
+     *        transitions lead to merged states on every class.
+     *
+     * States of the plain automaton are told apart by their outputs alone:
+     * each one is the only state that reports its own pattern after reading
+     * that pattern's rest. Reporting lengths instead of patterns lets the
+     * tails of patterns that end alike (many names ending in ".com") share
+     * states. The pattern itself is then found from the text a match covers,
+     * which is exactly one pattern of that length up to duplicates (see
+     * reportWindow), at the cost of hashing and comparing that text once per
+     * match. Equivalence is Moore's partition refinement: states
+     * start grouped by reported lengths and groups split by their targets'
+     * groups until no group splits.
+     *
+     * The table, outputs and state count are replaced; the result lists the
+     * merged states in order of first appearance in `order`, root first,
+     * ready for groupAccepting.
+     *
+     * @note Time Complexity: O(rounds * states * stride * log states), where
+     *       rounds is at most the longest pattern length.
+     */
+    vector<StateT> mergeEquivalentStates(const vector<StateT>& order, const vector<vector<SymbolT>>& patterns) {
+        map<vector<uint32_t>, uint32_t> groups;
+        vector<uint32_t> group(stateCount);
+        for (size_t state = 0; state < stateCount; ++state) {
+            group[state] = groups.emplace(reportedLengths(state), static_cast<uint32_t>(groups.size())).first->second;
+        }
+        size_t groupCount = groups.size();
+
+        // Each round, a state's signature is its group and its targets' groups.
+        size_t width = stride + 1;
+        vector<uint32_t> signature(stateCount * width);
+        vector<size_t> sorted(stateCount);
+        auto rowOf = [&signature, width](size_t state) { return signature.begin() + state * width; };
+        for (;;) {
+            for (size_t state = 0; state < stateCount; ++state) {
+                auto row = rowOf(state);
+                row[0] = group[state];
+                for (size_t c = 0; c < stride; ++c) {
+                    row[c + 1] = group[table[state * stride + c] / stride];
+                }
+            }
+            iota(sorted.begin(), sorted.end(), 0);
+            sort(sorted.begin(), sorted.end(), [&rowOf, width](size_t a, size_t b) {
+                return lexicographical_compare(rowOf(a), rowOf(a) + width, rowOf(b), rowOf(b) + width);
+            });
+            size_t refined = 0;
+            for (size_t k = 0; k < stateCount; ++k) {
+                if (k == 0 || !equal(rowOf(sorted[k - 1]), rowOf(sorted[k - 1]) + width, rowOf(sorted[k]))) {
+                    ++refined;
+                }
+                group[sorted[k]] = static_cast<uint32_t>(refined - 1);
+            }
+            if (refined == groupCount) {
+                break;
+            }
+            groupCount = refined;
+        }
+
+        vector<size_t> mergedId(groupCount, numeric_limits<size_t>::max());
+        vector<StateT> representative;
+        for (StateT state : order) {
+            if (mergedId[group[state]] == numeric_limits<size_t>::max()) {
+                mergedId[group[state]] = representative.size();
+                representative.push_back(state);
+            }
+        }
+        HugePageArray<StateT> merged(groupCount * stride, false);
+        vector<uint32_t> mergedBegin(1, 0);
+        vector<int> mergedLengths;
+        for (size_t id = 0; id < groupCount; ++id) {
+            size_t state = representative[id];
+            for (size_t c = 0; c < stride; ++c) {
+                merged[id * stride + c] = static_cast<StateT>(mergedId[group[table[state * stride + c] / stride]] * stride);
+            }
+            for (uint32_t length : reportedLengths(state)) {
+                mergedLengths.push_back(static_cast<int>(length));
+            }
+            mergedBegin.push_back(static_cast<uint32_t>(mergedLengths.size()));
+        }
+        table = move(merged);
+        outputLink.assign(groupCount, 0);
+        outputBegin.swap(mergedBegin);
+        outputPatterns.swap(mergedLengths);
+        stateCount = groupCount;
+        minimized = true;
+
+        for (const vector<SymbolT>& pattern : patterns) {
+            patternOffsets.push_back(patternSymbols.size());
+            patternSymbols.insert(patternSymbols.end(), pattern.begin(), pattern.end());
+        }
+        patternOffsets.push_back(patternSymbols.size());
+        hashPatterns();
+
+        vector<StateT> mergedOrder(groupCount);
+        iota(mergedOrder.begin(), mergedOrder.end(), 0);
+        return mergedOrder;
+    }
+
+    // Hashes of the stored patterns, for looking up match windows.
+    void hashPatterns() {
+        patternHashes.clear();
+        maxPatternLength = 0;
+        for (size_t p = 0; p < patternLengths.size(); ++p) {
+            maxPatternLength = max<size_t>(maxPatternLength, patternLengths[p]);
+            if (patternLengths[p] != 0) {
+                patternHashes.emplace_back(hashSymbols(&patternSymbols[patternOffsets[p]], patternLengths[p]),
+                                           static_cast<int>(p));
+            }
+        }
+        sort(patternHashes.begin(), patternHashes.end());
+    }
+
+    // Saved automata start with this header, in native byte order.
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t stateBytes;  // sizeof(StateT)
+        uint32_t symbolBytes; // sizeof(SymbolT)
+        uint32_t minimized;
+        uint32_t patternCount;
+        uint64_t stride;
+        uint64_t stateCount;
+        uint64_t acceptThreshold;
+    };
+    static const uint32_t kFileMagic = 0x41434341; // "ACCA"
+    static const uint32_t kFileVersion = 1;
+
+    template <typename T>
+    static void writeArray(ostream& out, const T* values, size_t count) {
+        uint64_t size = count;
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(reinterpret_cast<const char*>(values), count * sizeof(T));
+    }
+
+    // Reads an array written by writeArray that must hold `expected` values
+    // within the `remaining` bytes. It grows as data arrives, so a corrupt
+    // count on an unseekable stream fails at the end of input instead of
+    // allocating it up front.
+    template <typename T>
+    static bool readArray(istream& in, vector<T>& values, uint64_t expected, uint64_t& remaining) {
+        const uint64_t kPiece = (1 << 20) / sizeof(T);
+        uint64_t size = 0;
+        if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)) || size != expected ||
+            remaining < sizeof(size) || size > (remaining - sizeof(size)) / sizeof(T)) {
+            return false;
+        }
+        remaining -= sizeof(size) + size * sizeof(T);
+        values.clear();
+        while (values.size() < size) {
+            size_t done = values.size();
+            values.resize(done + min(kPiece, size - done));
+            if (!in.read(reinterpret_cast<char*>(values.data() + done), (values.size() - done) * sizeof(T))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Whether a loaded automaton is safe to scan: every transition,
+     *        link and output refers to something that exists, and output
+     *        chains get strictly shorter, so reporting terminates. A minimized
+     *        automaton may only list lengths of stored patterns, whose hashes
+     *        load() then recomputes, so lookups and length lists agree.
+     */
+    bool consistent(const vector<StateT>& transitions) const {
+        size_t cells = stateCount * stride;
+        if (stateCount == 0 || stride != symbols.size() + 1 || !is_sorted(symbols.begin(), symbols.end()) ||
+            adjacent_find(symbols.begin(), symbols.end()) != symbols.end() || transitions.size() != cells ||
+            (stateCount - 1) * stride > numeric_limits<StateT>::max() || acceptThreshold % stride != 0 ||
+            acceptThreshold == 0 || acceptThreshold > cells || outputLink.size() != stateCount ||
+            outputBegin.size() != stateCount + 1 || outputBegin[0] != 0 ||
+            outputBegin.back() != outputPatterns.size() || !is_sorted(outputBegin.begin(), outputBegin.end())) {
+            return false;
+        }
+        for (StateT next : transitions) {
+            if (next % stride != 0 || next >= cells) {
+                return false;
+            }
+        }
+        for (int output : outputPatterns) {
+            if (minimized ? output <= 0 : output < 0 || static_cast<size_t>(output) >= patternLengths.size()) {
+                return false;
+            }
+        }
+        if (minimized) {
+            vector<uint32_t> lengths = patternLengths;
+            sort(lengths.begin(), lengths.end());
+            for (int output : outputPatterns) {
+                if (!binary_search(lengths.begin(), lengths.end(), static_cast<uint32_t>(output))) {
+                    return false;
+                }
+            }
+            if (patternOffsets.size() != patternLengths.size() + 1 || patternOffsets[0] != 0 ||
+                patternOffsets.back() != patternSymbols.size()) {
+                return false;
+            }
+            for (size_t p = 0; p < patternLengths.size(); ++p) {
+                if (patternOffsets[p] > patternOffsets[p + 1] ||
+                    patternOffsets[p + 1] - patternOffsets[p] != patternLengths[p]) {
+                    return false;
+                }
+            }
+            return all_of(outputLink.begin(), outputLink.end(), [](StateT link) { return link == 0; });
+        }
+        auto lengthOf = [this](size_t state) { return patternLengths[outputPatterns[outputBegin[state]]]; };
+        for (size_t state = 0; state < stateCount; ++state) {
+            size_t link = outputLink[state];
+            if (link >= stateCount || (link != 0 && !hasOwnOutputs(link)) ||
+                (link != 0 && hasOwnOutputs(state) && lengthOf(link) >= lengthOf(state))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Stably moves the accepting states of `order` (root first) behind all others.
+    vector<StateT> groupAccepting(const vector<StateT>& order) const {
+        vector<StateT> grouped = {0};
+        grouped.reserve(order.size());
+        for (bool acceptingPass : {false, true}) {
+            for (size_t k = 1; k < order.size(); ++k) {
+                if (accepting(order[k]) == acceptingPass) {
+                    grouped.push_back(order[k]);
+                }
+            }
+        }
+        return grouped;
+    }
+
+    /**
+     * @brief Renumbers the states so order[id] becomes state id.
+     *
+     * `order` starts with the root and lists every accepting state after every
+     * other one. The table is rebuilt, in the configured memory, with entries
+     * premultiplied by the stride; output lists and links follow the states.
+     */
+    void applyOrder(const vector<StateT>& order) {
+        vector<StateT> newId(stateCount);
+        for (size_t id = 0; id < stateCount; ++id) {
+            newId[order[id]] = static_cast<StateT>(id);
+        }
+        acceptThreshold = stateCount * stride;
+        for (size_t id = stateCount; id-- > 1;) {
+            if (!accepting(order[id])) {
+                break;
+            }
+            acceptThreshold = id * stride;
+        }
+
+        HugePageArray<StateT> newTable(table.size(), hugePages);
+        vector<StateT> newOutputLink(stateCount);
+        vector<uint32_t> newOutputBegin(stateCount + 1, 0);
+        vector<int> newOutputPatterns;
+        newOutputPatterns.reserve(outputPatterns.size());
+        for (size_t id = 0; id < stateCount; ++id) {
+            StateT old = order[id];
+            const StateT* oldRow = &table[size_t(old) * stride];
+            StateT* row = &newTable[id * stride];
+            for (size_t c = 0; c < stride; ++c) {
+                row[c] = static_cast<StateT>(newId[oldRow[c] / stride] * stride);
+            }
+            newOutputLink[id] = newId[outputLink[old]];
+            newOutputPatterns.insert(newOutputPatterns.end(), outputPatterns.begin() + outputBegin[old],
+                                     outputPatterns.begin() + outputBegin[old + 1]);
+            newOutputBegin[id + 1] = static_cast<uint32_t>(newOutputPatterns.size());
+        }
+        table = move(newTable);
+        outputLink.swap(newOutputLink);
+        outputBegin.swap(newOutputBegin);
+        outputPatterns.swap(newOutputPatterns);
+    }
+
+    /**
+     * @brief Reports the patterns of `length` equal to text[end + 1 - length .. end],
+     *        in index order; text[0] is at stream offset `base`.
+     *
+     * A minimized automaton only reaches here if one of them is. Callers
+     * keep the window within text (see scan()); a window that would still
+     * start before text[0], which only a corrupt loaded file can produce, is
+     * skipped.
+     */
+    template <typename Callback>
+    void reportWindow(const SymbolT* text, size_t end, size_t length, size_t base, Callback& onMatch) const {
+        if (length > end + 1) {
+            return;
+        }
+        const SymbolT* window = text + end + 1 - length;
+        uint64_t hash = hashSymbols(window, length);
+        auto it = lower_bound(patternHashes.begin(), patternHashes.end(), make_pair(hash, numeric_limits<int>::min()));
+        for (; it != patternHashes.end() && it->first == hash; ++it) {
+            int p = it->second;
+            if (patternLengths[p] == length && equal(window, window + length, patternSymbols.begin() + patternOffsets[p])) {
+                onMatch(Match{p, base + end + 1 - length, base + end, 0});
+            }
+        }
+    }
+
+    // Reports the matches ending in accepting `state` (premultiplied) at text[end],
+    // text[0] being at stream offset `base`.
+    template <typename Callback>
+    void reportMatches(size_t state, const SymbolT* text, size_t end, size_t base, Callback& onMatch) const {
+        size_t output = state / stride;
+        if (minimized) {
+            for (uint32_t k = outputBegin[output]; k < outputBegin[output + 1]; ++k) {
+                reportWindow(text, end, outputPatterns[k], base, onMatch);
+            }
+            return;
+        }
+        if (!hasOwnOutputs(output)) {
+            output = outputLink[output];
+        }
+        for (; output != 0; output = outputLink[output]) {
+            for (uint32_t k = outputBegin[output]; k < outputBegin[output + 1]; ++k) {
+                int p = outputPatterns[k];
+                onMatch(Match{p, base + end + 1 - patternLengths[p], base + end, 0});
+            }
+        }
+    }
+
+    // Scans text[from..to) from `state`; text[0] is at stream offset `base`.
+    template <typename Callback>
+    StateT scanRange(StateT state, const SymbolT* text, size_t from, size_t to, size_t base,
+                     Callback& onMatch) const {
+        const StateT* transitions = table.data();
+        size_t current = state;
+        for (size_t i = from; i < to; ++i) {
+            current = transitions[current + classFor(text[i])];
+            if (current >= acceptThreshold) {
+                reportMatches(current, text, i, base, onMatch);
+            }
+        }
+        return static_cast<StateT>(current);
+    }
+
+public:
+    // false if the automaton needed more states than StateT can index.
+    bool valid() const {
+        return stateCount > 0;
+    }
+
+    size_t size() const {
+        return stateCount;
+    }
+
+    // Bytes of the transition table, the part StateT scales.
+    size_t tableBytes() const {
+        return table.size() * sizeof(StateT);
+    }
+
+    // Bytes of everything the automaton holds: the table, symbol classes,
+    // output lists and, once minimized, the pattern store behind them.
+    size_t memoryBytes() const {
+        return tableBytes() + classOf.size() * sizeof(uint32_t) + symbols.size() * sizeof(SymbolT) +
+               outputLink.size() * sizeof(StateT) + outputBegin.size() * sizeof(uint32_t) +
+               outputPatterns.size() * sizeof(int) + patternLengths.size() * sizeof(uint32_t) +
+               patternSymbols.size() * sizeof(SymbolT) + patternOffsets.size() * sizeof(size_t) +
+               patternHashes.size() * sizeof(pair<uint64_t, int>);
+    }
+
+    // Number of states in which no match ends; they hold ids [0, count).
+    size_t nonAcceptingStates() const {
+        return acceptThreshold / stride;
+    }
+
+    // Whether the transition table ended up in a huge-page mapping.
+    bool tableOnHugePages() const {
+        return table.mapped();
+    }
+
+    /**
+     * @brief Adds the states a search of data[0..size) visits to `visits`,
+     *        indexed by state id, so a profile can cover a whole corpus.
+     *
+     * `visits` is resized to size() if needed. The counts refer to the
+     * current numbering and are stale after any reordering.
+     */
+    void recordVisits(const SymbolT* data, size_t size, vector<uint64_t>& visits) const {
+        visits.resize(stateCount, 0);
+        const StateT* transitions = table.data();
+        size_t current = 0;
+        for (size_t i = 0; i < size; ++i) {
+            current = transitions[current + classFor(data[i])];
+            ++visits[current / stride];
+        }
+    }
+
+    void recordVisits(string_view data, vector<uint64_t>& visits) const {
+        static_assert(sizeof(SymbolT) == 1, "string samples are for byte automata");
+        recordVisits(reinterpret_cast<const SymbolT*>(data.data()), data.size(), visits);
+    }
+
+    /**
+     * @brief Renumbers states by descending visit count, as recorded by
+     *        recordVisits() against the current numbering.
+     *
+     * Within the non-accepting and the accepting id ranges, states are
+     * ordered by descending visit count, ties keeping the current (initially
+     * BFS) order. The rows a scan touches most then share cache lines and
+     * pages at the front of each range, and rows never visited sink to the
+     * back. Matches are unchanged; save() keeps the layout.
+     *
+     * @note Time Complexity: O(states log states + states * stride).
+     */
+    void reorderByVisits(const vector<uint64_t>& visits) {
+        if (!valid() || visits.size() != stateCount) {
+            return;
+        }
+        vector<StateT> order(stateCount);
+        for (size_t id = 0; id < stateCount; ++id) {
+            order[id] = static_cast<StateT>(id);
+        }
+        size_t split = nonAcceptingStates();
+        auto hotter = [&visits](StateT a, StateT b) { return visits[a] > visits[b]; };
+        stable_sort(order.begin() + 1, order.begin() + split, hotter);
+        stable_sort(order.begin() + split, order.end(), hotter);
+        applyOrder(order);
+    }
+
+    // Renumbers states by how often a search of `sample` visits them.
+    void reorderByFrequency(const SymbolT* sample, size_t size) {
+        if (!valid()) {
+            return;
+        }
+        vector<uint64_t> visits;
+        recordVisits(sample, size, visits);
+        reorderByVisits(visits);
+    }
+
+    void reorderByFrequency(string_view sample) {
+        static_assert(sizeof(SymbolT) == 1, "string samples are for byte automata");
+        reorderByFrequency(reinterpret_cast<const SymbolT*>(sample.data()), sample.size());
+    }
+
+    // Where a stream scanned in pieces stands between scan() calls.
+    struct ScanCursor {
+        StateT state = 0;        // Opaque premultiplied state; 0 is the root
+        size_t offset = 0;       // Stream offset of the next symbol
+        vector<SymbolT> history; // Last symbols scanned, kept by minimized automata
+    };
+
+    /**
+     * @brief Scans the next piece data[0..size) of the stream behind `cursor`,
+     *        reporting the matches ending in it with stream offsets.
+     *
+     * A minimized automaton identifies a match from the text it covers, so
+     * the cursor carries the last maxPatternLength - 1 symbols across calls
+     * and matches that start in an earlier piece are still identified.
+     *
+     * @param onMatch Callable invoked as onMatch(const Match&); payloads are 0.
+     */
+    template <typename Callback>
+    void scan(ScanCursor& cursor, const SymbolT* data, size_t size, Callback&& onMatch) const {
+        if (!valid()) {
+            return;
+        }
+        if (!minimized) {
+            cursor.state = scanRange(cursor.state, data, 0, size, cursor.offset, onMatch);
+            cursor.offset += size;
+            return;
+        }
+        // Symbols from data[keep] on only reach back into data; the first
+        // ones are scanned joined to the history.
+        size_t keep = maxPatternLength > 0 ? maxPatternLength - 1 : 0;
+        size_t head = min(size, keep);
+        vector<SymbolT> joined(cursor.history);
+        joined.insert(joined.end(), data, data + head);
+        size_t joinedBase = cursor.offset - cursor.history.size();
+        StateT state = scanRange(cursor.state, joined.data(), cursor.history.size(), joined.size(), joinedBase, onMatch);
+        cursor.state = scanRange(state, data, head, size, cursor.offset, onMatch);
+        cursor.offset += size;
+        if (size >= keep) {
+            cursor.history.assign(data + size - keep, data + size);
+        } else {
+            joined.erase(joined.begin(), joined.end() - min(joined.size(), keep));
+            cursor.history.swap(joined);
+        }
+    }
+
+    // Reports every match in data[0..size), as AhoCorasick::search() orders them.
+    template <typename Callback>
+    void search(const SymbolT* data, size_t size, Callback&& onMatch) const {
+        if (valid()) {
+            scanRange(0, data, 0, size, 0, onMatch);
+        }
+    }
+
+    template <typename Callback>
+    void search(const vector<SymbolT>& data, Callback&& onMatch) const {
+        search(data.data(), data.size(), onMatch);
+    }
+
+    // Streams searchInterleaved() advances together.
+    static constexpr size_t kInterleavedStreams = 8;
+
+    /**
+     * @brief Scans several independent texts in lockstep, one step of each
+     *        stream in turn, groups of kInterleavedStreams at a time.
+     *
+     * A single scan is one long chain of dependent table loads; once the
+     * table outgrows the caches every step waits on memory. Interleaving
+     * keeps several such chains in flight at once, and with `prefetch` each
+     * stream's next table cell, known as soon as its next symbol is, is
+     * requested a full round before it is needed.
+     *
+     * @param onMatch Callable invoked as onMatch(size_t stream, const Match&),
+     *                positions relative to the stream's own text.
+     */
+    template <typename Callback>
+    void searchInterleaved(const vector<string_view>& texts, Callback&& onMatch,
+                           bool prefetch = true) const {
+        static_assert(sizeof(SymbolT) == 1, "interleaved scanning takes byte texts");
+        if (!valid()) {
+            return;
+        }
+        const StateT* transitions = table.data();
+        for (size_t first = 0; first < texts.size(); first += kInterleavedStreams) {
+            size_t lanes = min(kInterleavedStreams, texts.size() - first);
+            const SymbolT* data[kInterleavedStreams];
+            size_t state[kInterleavedStreams] = {};
+            size_t common = texts[first].size();
+            for (size_t k = 0; k < lanes; ++k) {
+                data[k] = reinterpret_cast<const SymbolT*>(texts[first + k].data());
+                common = min(common, texts[first + k].size());
+            }
+
+            for (size_t i = 0; i < common; ++i) {
+                for (size_t k = 0; k < lanes; ++k) {
+                    size_t current = transitions[state[k] + classFor(data[k][i])];
+                    state[k] = current;
+                    if (prefetch && i + 1 < common) {
+                        __builtin_prefetch(transitions + current + classFor(data[k][i + 1]));
+                    }
+                    if (current >= acceptThreshold) {
+                        size_t stream = first + k;
+                        auto report = [&onMatch, stream](const Match& match) { onMatch(stream, match); };
+                        reportMatches(current, data[k], i, 0, report);
+                    }
+                }
+            }
+
+            // Streams longer than the shortest finish on their own.
+            for (size_t k = 0; k < lanes; ++k) {
+                size_t stream = first + k;
+                auto report = [&onMatch, stream](const Match& match) { onMatch(stream, match); };
+                scanRange(static_cast<StateT>(state[k]), data[k], common, texts[stream].size(), 0, report);
+            }
+        }
+    }
+
+    // Byte automata scan text directly.
+    template <typename Callback, typename S = SymbolT, typename = enable_if_t<sizeof(S) == 1>>
+    void search(string_view text, Callback&& onMatch) const {
+        search(reinterpret_cast<const SymbolT*>(text.data()), text.size(), onMatch);
+    }
+
+    /**
+     * @brief Writes the automaton to `out` in its current state numbering,
+     *        so a layout tuned by reorderByVisits() is kept.
+     *
+     * The format is native byte order and only load()s into the same StateT
+     * and SymbolT.
+     *
+     * @return false if the automaton is not valid() or writing failed.
+     */
+    bool save(ostream& out) const {
+        if (!valid()) {
+            return false;
+        }
+        FileHeader header = {};
+        header.magic = kFileMagic;
+        header.version = kFileVersion;
+        header.stateBytes = sizeof(StateT);
+        header.symbolBytes = sizeof(SymbolT);
+        header.minimized = minimized;
+        header.patternCount = static_cast<uint32_t>(patternLengths.size());
+        header.stride = stride;
+        header.stateCount = stateCount;
+        header.acceptThreshold = acceptThreshold;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeArray(out, symbols.data(), symbols.size());
+        writeArray(out, table.data(), table.size());
+        writeArray(out, outputLink.data(), outputLink.size());
+        writeArray(out, outputBegin.data(), outputBegin.size());
+        writeArray(out, outputPatterns.data(), outputPatterns.size());
+        writeArray(out, patternLengths.data(), patternLengths.size());
+        writeArray(out, patternSymbols.data(), patternSymbols.size());
+        writeArray(out, patternOffsets.data(), patternOffsets.size());
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * @brief Replaces the automaton with one written by save().
+     *
+     * Only `options.hugePages` applies; whether the states were merged is
+     * part of the saved automaton.
+     *
+     * @return false, leaving the automaton not valid(), if `in` does not hold
+     *         a consistent automaton of these StateT and SymbolT.
+     * @note Time Complexity: O(file size + states * stride).
+     */
+    bool load(istream& in, const CompiledOptions& options = CompiledOptions()) {
+        *this = CompiledAutomaton();
+        streampos start = in.tellg();
+        uint64_t remaining = numeric_limits<uint64_t>::max();
+        if (start != streampos(-1) && in.seekg(0, ios::end)) {
+            remaining = static_cast<uint64_t>(in.tellg() - start);
+            in.seekg(start);
+        }
+
+        FileHeader header;
+        vector<StateT> transitions;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || remaining < sizeof(header) ||
+            header.magic != kFileMagic || header.version != kFileVersion || header.stateBytes != sizeof(StateT) ||
+            header.symbolBytes != sizeof(SymbolT) || header.minimized > 1) {
+            return false;
+        }
+        remaining -= sizeof(header);
+        minimized = header.minimized != 0;
+        stride = header.stride;
+        stateCount = header.stateCount;
+        acceptThreshold = header.acceptThreshold;
+
+        // Array sizes follow from the header (and from arrays read before them);
+        // check the header first so that those products cannot overflow.
+        uint64_t patterns = header.patternCount;
+        uint64_t maxStride = (uint64_t(numeric_limits<SymbolT>::max()) + 1) + 1;
+        auto fail = [this]() {
+            *this = CompiledAutomaton();
+            return false;
+        };
+        if (stride == 0 || stride > maxStride || stateCount == 0 ||
+            stateCount - 1 > numeric_limits<StateT>::max() / stride) {
+            return fail();
+        }
+        if (!readArray(in, symbols, stride - 1, remaining) ||
+            !readArray(in, transitions, uint64_t(stateCount) * stride, remaining) ||
+            !readArray(in, outputLink, stateCount, remaining) ||
+            !readArray(in, outputBegin, stateCount + 1, remaining)) {
+            return fail();
+        }
+        // Minimized states list distinct lengths, at most one per pattern each.
+        uint64_t maxOutputs = !minimized ? patterns
+                              : patterns != 0 && stateCount > numeric_limits<uint64_t>::max() / patterns
+                                  ? numeric_limits<uint64_t>::max() : stateCount * patterns;
+        if (outputBegin.back() > maxOutputs || !readArray(in, outputPatterns, outputBegin.back(), remaining) ||
+            !readArray(in, patternLengths, patterns, remaining)) {
+            return fail();
+        }
+        uint64_t storedSymbols = minimized ? accumulate(patternLengths.begin(), patternLengths.end(), uint64_t(0)) : 0;
+        if (!readArray(in, patternSymbols, storedSymbols, remaining) ||
+            !readArray(in, patternOffsets, minimized ? patterns + 1 : 0, remaining) || !consistent(transitions)) {
+            return fail();
+        }
+
+        assignClasses();
+        hugePages = options.hugePages;
+        table = HugePageArray<StateT>(transitions.size(), hugePages);
+        copy(transitions.begin(), transitions.end(), table.data());
+        if (minimized) {
+            hashPatterns();
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Aho-Corasick over 32-bit token ids, for phrase search in corpora
+ *        that are already tokenized.
+ *
+ * The TrieNode design scaled to a large vocabulary: every state keeps its
+ * children as a sorted (token, child) list, flattened for all states into
+ * one CSR array, and the root, where a scan spends most of its steps and
+ * which has the most children, gets a dense table indexed by token id up
+ * to kMaxRootTable entries; rarer root tokens beyond it use the root's CSR
+ * list like any other state.
+ * Failure links are followed at run time rather than folded into rows, so
+ * memory grows with the total phrase length, not with the vocabulary times
+ * the state count. States are numbered in BFS order, so shallow states,
+ * the ones visited most, share cache lines.
+ */
+class TokenAutomaton {
+private:
+    // Children lists longer than this are binary searched; shorter ones scanned.
+    static const uint32_t kLinearSearchLimit = 8;
+    // Root tokens from here up are left out of the dense row (at most 4 MiB),
+    // so a few huge (e.g. hashed) ids cannot blow it up.
+    static const uint32_t kMaxRootTable = 1u << 20;
+
+    vector<uint32_t> rootNext;       // Dense root row; tokens past its end use the root's child list
+    vector<uint32_t> childBegin;     // CSR: children of state s are at [childBegin[s], childBegin[s + 1])
+    vector<uint32_t> childTokens;    //   sorted by token
+    vector<uint32_t> childStates;
+    vector<uint32_t> failure;
+    vector<uint32_t> outputLink;     // Nearest accepting proper suffix state; 0 (root) for none
+    vector<uint32_t> outputBegin;    // CSR: patterns ending at state s
+    vector<int> outputPatterns;
+    vector<uint32_t> patternLengths;
+
+    // The child of a non-root state on `token`, or 0 if none.
+    uint32_t child(uint32_t state, uint32_t token) const {
+        uint32_t begin = childBegin[state];
+        uint32_t end = childBegin[state + 1];
+        if (end - begin <= kLinearSearchLimit) {
+            for (uint32_t k = begin; k < end; ++k) {
+                if (childTokens[k] == token) {
+                    return childStates[k];
+                }
+            }
+            return 0;
+        }
+        const uint32_t* first = childTokens.data() + begin;
+        const uint32_t* last = childTokens.data() + end;
+        const uint32_t* it = lower_bound(first, last, token);
+        return it != last && *it == token ? childStates[it - childTokens.data()] : 0;
+    }
+
+    bool accepting(uint32_t state) const {
+        return outputBegin[state] != outputBegin[state + 1];
+    }
+
+public:
+    /**
+     * @brief Builds the automaton; a phrase's index is its position.
+     *
+     * Phrases are inserted in sorted order so each new child is appended to
+     * its parent's already sorted list, then the trie is renumbered breadth
+     * first into the CSR arrays.
+     *
+     * @note Time Complexity: O(L log P) for P phrases of total length L, plus the root table.
+     */
+    explicit TokenAutomaton(const vector<vector<uint32_t>>& phrases) {
+        vector<int> order(phrases.size());
+        for (size_t p = 0; p < phrases.size(); ++p) {
+            order[p] = static_cast<int>(p);
+        }
+        stable_sort(order.begin(), order.end(), [&phrases](int a, int b) { return phrases[a] < phrases[b]; });
+
+        // Temporary trie; in sorted order an existing child is always the last one added.
+        vector<vector<pair<uint32_t, uint32_t>>> children(1);
+        vector<uint32_t> endState(phrases.size());
+        for (int p : order) {
+            uint32_t state = 0;
+            for (uint32_t token : phrases[p]) {
+                vector<pair<uint32_t, uint32_t>>& list = children[state];
+                if (list.empty() || list.back().first != token) {
+                    list.emplace_back(token, static_cast<uint32_t>(children.size()));
+                    children.emplace_back();
+                }
+                state = children[state].back().second;
+            }
+            endState[p] = state;
+        }
+
+        // Renumber breadth first: newId[old] and the BFS order of old ids.
+        size_t states = children.size();
+        vector<uint32_t> newId(states);
+        vector<uint32_t> bfs = {0};
+        bfs.reserve(states);
+        for (size_t head = 0; head < bfs.size(); ++head) {
+            newId[bfs[head]] = static_cast<uint32_t>(head);
+            for (const pair<uint32_t, uint32_t>& edge : children[bfs[head]]) {
+                bfs.push_back(edge.second);
+            }
+        }
+        childBegin.assign(states + 1, 0);
+        for (size_t s = 0; s < states; ++s) {
+            const vector<pair<uint32_t, uint32_t>>& list = children[bfs[s]];
+            childBegin[s + 1] = childBegin[s] + static_cast<uint32_t>(list.size());
+            for (const pair<uint32_t, uint32_t>& edge : list) {
+                childTokens.push_back(edge.first);
+                childStates.push_back(newId[edge.second]);
+            }
+        }
+        children.clear();
+
+        // Tokens from kMaxRootTable up stay out of the row (and cannot wrap it to 0).
+        uint32_t rootTokens = 0;
+        for (uint32_t k = childBegin[0]; k < childBegin[1]; ++k) {
+            if (childTokens[k] < kMaxRootTable) {
+                rootTokens = max(rootTokens, childTokens[k] + 1);
+            }
+        }
+        rootNext.assign(rootTokens, 0);
+        for (uint32_t k = childBegin[0]; k < childBegin[1]; ++k) {
+            if (childTokens[k] < rootNext.size()) {
+                rootNext[childTokens[k]] = childStates[k];
+            }
+        }
+
+        outputBegin.assign(states + 1, 0);
+        for (uint32_t& state : endState) {
+            state = newId[state];
+            ++outputBegin[state + 1];
+        }
+        for (size_t s = 0; s < states; ++s) {
+            outputBegin[s + 1] += outputBegin[s];
+        }
+        outputPatterns.resize(phrases.size());
+        vector<uint32_t> fill(outputBegin.begin(), outputBegin.end() - 1);
+        for (size_t p = 0; p < phrases.size(); ++p) {
+            outputPatterns[fill[endState[p]]++] = static_cast<int>(p);
+            patternLengths.push_back(static_cast<uint32_t>(phrases[p].size()));
+        }
+
+        // Ids are in BFS order, so a state's failure target is always computed first.
+        failure.assign(states, 0);
+        outputLink.assign(states, 0);
+        for (uint32_t s = 0; s < states; ++s) {
+            if (s != 0) {
+                uint32_t fail = failure[s];
+                outputLink[s] = accepting(fail) ? fail : outputLink[fail];
+            }
+            for (uint32_t k = childBegin[s]; k < childBegin[s + 1]; ++k) {
+                failure[childStates[k]] = s == 0 ? 0 : step(failure[s], childTokens[k]);
+            }
+        }
+    }
+
+    // The state after reading `token` in `state`, following failure links as needed.
+    uint32_t step(uint32_t state, uint32_t token) const {
+        while (state != 0) {
+            uint32_t next = child(state, token);
+            if (next != 0) {
+                return next;
+            }
+            state = failure[state];
+        }
+        return token < rootNext.size() ? rootNext[token] : child(0, token);
+    }
+
+    /**
+     * @brief Scans tokens[0..size) from `state` and returns the state reached.
+     *
+     * @param base Stream offset of tokens[0], added to reported positions.
+     * @param onMatch Callable invoked as onMatch(const Match&), positions in tokens.
+     */
+    template <typename Callback>
+    uint32_t scan(uint32_t state, const uint32_t* tokens, size_t size, size_t base, Callback&& onMatch) const {
+        for (size_t i = 0; i < size; ++i) {
+            state = step(state, tokens[i]);
+            uint32_t output = accepting(state) ? state : outputLink[state];
+            for (; output != 0; output = outputLink[output]) {
+                for (uint32_t k = outputBegin[output]; k < outputBegin[output + 1]; ++k) {
+                    int p = outputPatterns[k];
+                    size_t end = base + i;
+                    onMatch(Match{p, end + 1 - patternLengths[p], end, 0});
+                }
+            }
+        }
+        return state;
+    }
+
+    template <typename Callback>
+    void search(const vector<uint32_t>& tokens, Callback&& onMatch) const {
+        scan(0, tokens.data(), tokens.size(), 0, onMatch);
+    }
+
+    size_t size() const {
+        return failure.size();
+    }
+
+    // Bytes held by the automaton's arrays.
+    size_t memoryBytes() const {
+        return sizeof(uint32_t) * (rootNext.size() + childBegin.size() + childTokens.size() + childStates.size() +
+                                   failure.size() + outputLink.size() + outputBegin.size() +
+                                   patternLengths.size()) +
+               sizeof(int) * outputPatterns.size();
+    }
+};
+
+/**
+ * @brief A compiled form of an AhoCorasick automaton that keeps dense rows
+ *        only for shallow states and collapses long chains into segments.
+ *
+ * Scans spend most of their steps in the first few trie levels, while most
+ * states sit deep inside long patterns with a single child. States up to
+ * `denseDepth` get full 256-entry rows with failure links folded in, so a
+ * step there is one load as in a DFA. Deeper states keep only their real
+ * children, inline for the common single child and as a sorted edge list
+ * otherwise, and fall back along failure links on a miss, as the TrieNode
+ * automaton does, until a dense state answers. Failure links always lead
+ * to shallower states, so a miss ends in a dense row after a few hops.
+ *
+ * Deep nodes with one child and nothing to report, the bulk of a dictionary
+ * of URLs or hashes, are not states at all: each maximal run of them is a
+ * path segment holding one label byte, one failure link and a run length
+ * per position (six bytes instead of a state record). A scan inside a
+ * segment compares the rest of the run against the text with memcmp and
+ * jumps to its end, falling back byte by byte on a mismatch.
+ *
+ * States are numbered breadth first, dense ones first. Matches, payloads
+ * and anchors are the same as the source automaton's search() reports.
+ */
+class HybridAutomaton {
+private:
+    static const uint32_t kNone = numeric_limits<uint32_t>::max();
+    // Set in a state value that is a position inside a path segment.
+    static const uint32_t kSegment = 0x80000000u;
+    // Edge lists longer than this are binary searched; shorter ones scanned.
+    static const uint32_t kLinearSearchLimit = 8;
+    // Longest run a single segment jump compares.
+    static const uint32_t kMaxRun = 255;
+
+    // A state deeper than denseDepth.
+    struct DeepState {
+        uint32_t failure;
+        uint32_t firstEdge;   // The only child if edgeCount == 1, else the first index into the edge arrays
+        uint16_t edgeCount;
+        uint8_t onlyByte;     // Byte leading to the only child if edgeCount == 1
+    };
+
+    uint32_t denseCount = 0;         // States [0, denseCount) have dense rows
+    vector<uint32_t> denseRows;      // denseCount * 256 complete transitions
+    vector<DeepState> deepStates;    // State denseCount + k is deepStates[k]
+    vector<uint8_t> edgeBytes;       // Sorted per state
+    vector<uint32_t> edgeTargets;
+    vector<uint32_t> outputLink;     // Nearest proper suffix state with patterns, or kNone
+    vector<uint32_t> outputBegin;    // CSR: patterns ending at state s
+    vector<int> outputPatterns;
+
+    // Path segments, each followed by a sentinel slot whose failure entry is
+    // the state reached after the segment's last byte.
+    vector<uint8_t> segmentLabels;     // Byte leading out of each position
+    vector<uint8_t> segmentRuns;       // Positions left in the segment, capped at kMaxRun; 0 for sentinels
+    vector<uint32_t> segmentFailures;
+    size_t segmentPositionCount = 0;
+
+    vector<uint32_t> patternLengths;
+    vector<uint8_t> patternAnchors;
+    vector<uint64_t> patternPayloads;
+    bool hasAnchors = false;
+    bool folding = false;
+    char foldTable[256];
+    bool built = false;
+
+    uint32_t deepChild(const DeepState& state, uint8_t byte) const {
+        if (state.edgeCount == 1) {
+            return state.onlyByte == byte ? state.firstEdge : kNone;
+        }
+        const uint8_t* first = edgeBytes.data() + state.firstEdge;
+        const uint8_t* last = first + state.edgeCount;
+        if (state.edgeCount <= kLinearSearchLimit) {
+            for (const uint8_t* it = first; it != last; ++it) {
+                if (*it == byte) {
+                    return edgeTargets[it - edgeBytes.data()];
+                }
+            }
+            return kNone;
+        }
+        const uint8_t* it = lower_bound(first, last, byte);
+        return it != last && *it == byte ? edgeTargets[it - edgeBytes.data()] : kNone;
+    }
+
+    // The state after consuming the label of segment position `position`.
+    uint32_t afterPosition(uint32_t position) const {
+        return segmentRuns[position] == 1 ? segmentFailures[position + 1] : (position + 1) | kSegment;
+    }
+
+    uint32_t step(uint32_t state, uint8_t byte) const {
+        for (;;) {
+            if (state & kSegment) {
+                uint32_t position = state & ~kSegment;
+                if (segmentLabels[position] == byte) {
+                    return afterPosition(position);
+                }
+                state = segmentFailures[position];
+            } else if (state >= denseCount) {
+                const DeepState& deep = deepStates[state - denseCount];
+                uint32_t next = deepChild(deep, byte);
+                if (next != kNone) {
+                    return next;
+                }
+                state = deep.failure;
+            } else {
+                return denseRows[size_t(state) * 256 + byte];
+            }
+        }
+    }
+
+    bool reports(uint32_t state) const {
+        return !(state & kSegment) &&
+               (outputBegin[state] != outputBegin[state + 1] || outputLink[state] != kNone);
+    }
+
+public:
+    /**
+     * @brief Compiles `ac`, whose failure links must be built.
+     *
+     * @param denseDepth States at most this deep get dense rows; the root always does.
+     * @note Only the byte modes are supported; for the Unicode case-folding
+     *       modes the result is not valid().
+     * @note Time Complexity: O(trie nodes + dense states * 256).
+     */
+    explicit HybridAutomaton(const AhoCorasick& ac, unsigned denseDepth = 2) {
+        if (ac.unicodeFolding()) {
+            return;
+        }
+        folding = ac.caseFolding == CaseFolding::Ascii;
+        memcpy(foldTable, ac.foldTable, sizeof(foldTable));
+        patternLengths.assign(ac.patternLengths.begin(), ac.patternLengths.end());
+        patternAnchors = ac.patternAnchors;
+        patternPayloads = ac.patternPayloads;
+        hasAnchors = ac.hasAnchors;
+
+        // A deep node with one child that reports nothing lives in a segment.
+        auto inSegment = [denseDepth](const TrieNode* node, unsigned depth) {
+            return depth > denseDepth && node->children.size() == 1 && node->patternIndices.empty() &&
+                   node->outputLink == nullptr;
+        };
+
+        // Breadth-first numbering of the states; the dense ones form a prefix of it.
+        vector<const TrieNode*> nodes = {ac.root};
+        vector<unsigned> depth = {0};
+        vector<const TrieNode*> states;
+        for (size_t head = 0; head < nodes.size(); ++head) {
+            if (!inSegment(nodes[head], depth[head])) {
+                if (depth[head] <= denseDepth) {
+                    denseCount = static_cast<uint32_t>(states.size() + 1);
+                }
+                states.push_back(nodes[head]);
+            }
+            for (const auto& child : nodes[head]->children) {
+                nodes.push_back(child.second);
+                depth.push_back(depth[head] + 1);
+            }
+        }
+        unordered_map<const TrieNode*, uint32_t> id;
+        id.reserve(nodes.size());
+        for (size_t k = 0; k < states.size(); ++k) {
+            id[states[k]] = static_cast<uint32_t>(k);
+        }
+
+        // Lay out each segment from its head, a segment node whose parent is a state.
+        unordered_map<const TrieNode*, unsigned> stateDepth;
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            if (id.count(nodes[k])) {
+                stateDepth[nodes[k]] = depth[k];
+            }
+        }
+        vector<pair<const TrieNode*, uint32_t>> segmentEnds;   // Last node's child, sentinel slot
+        for (const TrieNode* parent : states) {
+            unsigned childDepth = stateDepth[parent] + 1;
+            for (const auto& child : parent->children) {
+                const TrieNode* node = child.second;
+                unsigned nodeDepth = childDepth;
+                vector<const TrieNode*> run;
+                while (inSegment(node, nodeDepth)) {
+                    run.push_back(node);
+                    node = node->children.begin()->second;
+                    ++nodeDepth;
+                }
+                uint32_t first = static_cast<uint32_t>(segmentLabels.size());
+                for (size_t j = 0; j < run.size(); ++j) {
+                    id[run[j]] = (first + static_cast<uint32_t>(j)) | kSegment;
+                    segmentLabels.push_back(static_cast<unsigned char>(run[j]->children.begin()->first));
+                    segmentRuns.push_back(static_cast<uint8_t>(min<size_t>(kMaxRun, run.size() - j)));
+                }
+                if (!run.empty()) {
+                    segmentEnds.emplace_back(node, static_cast<uint32_t>(segmentLabels.size()));
+                    segmentLabels.push_back(0);
+                    segmentRuns.push_back(0);
+                    segmentPositionCount += run.size();
+                }
+            }
+        }
+        auto idOf = [&id](const TrieNode* node) { return node == nullptr ? kNone : id.at(node); };
+        segmentFailures.resize(segmentLabels.size());
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            uint32_t value = id.at(nodes[k]);
+            if (value & kSegment) {
+                segmentFailures[value & ~kSegment] = idOf(nodes[k]->failureLink);
+            }
+        }
+        for (const auto& end : segmentEnds) {
+            segmentFailures[end.second] = id.at(end.first);
+        }
+
+        outputLink.resize(states.size());
+        outputBegin.assign(1, 0);
+        for (size_t k = 0; k < states.size(); ++k) {
+            outputLink[k] = idOf(states[k]->outputLink);
+            outputPatterns.insert(outputPatterns.end(), states[k]->patternIndices.begin(),
+                                  states[k]->patternIndices.end());
+            outputBegin.push_back(static_cast<uint32_t>(outputPatterns.size()));
+        }
+
+        // Dense rows in BFS order: a failure target is shallower, so its row is complete.
+        denseRows.assign(size_t(denseCount) * 256, 0);
+        for (uint32_t k = 0; k < denseCount; ++k) {
+            uint32_t* row = &denseRows[size_t(k) * 256];
+            if (k != 0) {
+                memcpy(row, &denseRows[size_t(idOf(states[k]->failureLink)) * 256], 256 * sizeof(uint32_t));
+            }
+            for (const auto& child : states[k]->children) {
+                row[static_cast<unsigned char>(child.first)] = id.at(child.second);
+            }
+        }
+
+        for (size_t k = denseCount; k < states.size(); ++k) {
+            DeepState deep{idOf(states[k]->failureLink), 0, static_cast<uint16_t>(states[k]->children.size()), 0};
+            if (deep.edgeCount == 1) {
+                deep.onlyByte = static_cast<unsigned char>(states[k]->children.begin()->first);
+                deep.firstEdge = id.at(states[k]->children.begin()->second);
+            } else {
+                // map<char> orders bytes >= 0x80 first; edges are sorted unsigned.
+                vector<pair<uint8_t, uint32_t>> edges;
+                for (const auto& child : states[k]->children) {
+                    edges.emplace_back(static_cast<unsigned char>(child.first), id.at(child.second));
+                }
+                sort(edges.begin(), edges.end());
+                deep.firstEdge = static_cast<uint32_t>(edgeBytes.size());
+                for (const auto& edge : edges) {
+                    edgeBytes.push_back(edge.first);
+                    edgeTargets.push_back(edge.second);
+                }
+            }
+            deepStates.push_back(deep);
+        }
+        built = true;
+    }
+
+    bool valid() const {
+        return built;
+    }
+
+    // States, not counting segment positions.
+    size_t size() const {
+        return outputLink.size();
+    }
+
+    size_t denseStates() const {
+        return denseCount;
+    }
+
+    // Trie nodes folded into path segments.
+    size_t segmentPositions() const {
+        return segmentPositionCount;
+    }
+
+    // Bytes of the transition structures (dense rows, deep states, edges, segments).
+    size_t transitionBytes() const {
+        return denseRows.size() * sizeof(uint32_t) + deepStates.size() * sizeof(DeepState) +
+               edgeBytes.size() + edgeTargets.size() * sizeof(uint32_t) + segmentLabels.size() +
+               segmentRuns.size() + segmentFailures.size() * sizeof(uint32_t);
+    }
+
+    /**
+     * @brief Reports every match in `text` that AhoCorasick::search() reports,
+     *        ordered by end position.
+     *
+     * @param onMatch Callable invoked as onMatch(const Match&).
+     * @note Segment runs are compared with memcmp; with ASCII folding the
+     *       text is folded byte by byte instead.
+     */
+    template <typename Callback>
+    void search(string_view text, Callback&& onMatch) const {
+        if (!built) {
+            return;
+        }
+        uint32_t state = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if ((state & kSegment) && !folding) {
+                // Nothing inside a run reports, so the matching part of a run is one jump.
+                uint32_t position = state & ~kSegment;
+                size_t length = min<size_t>(segmentRuns[position], text.size() - i);
+                const uint8_t* label = &segmentLabels[position];
+                if (memcmp(text.data() + i, label, length) == 0) {
+                    state = afterPosition(position + static_cast<uint32_t>(length) - 1);
+                    i += length - 1;
+                } else {
+                    size_t same = 0;
+                    while (static_cast<uint8_t>(text[i + same]) == label[same]) {
+                        ++same;
+                    }
+                    i += same;
+                    state = step((position + static_cast<uint32_t>(same)) | kSegment,
+                                 static_cast<unsigned char>(text[i]));
+                }
+            } else {
+                char ch = folding ? foldTable[static_cast<unsigned char>(text[i])] : text[i];
+                state = step(state, static_cast<unsigned char>(ch));
+            }
+            if (!reports(state)) {
+                continue;
+            }
+            for (uint32_t output = state; output != kNone; output = outputLink[output]) {
+                for (uint32_t k = outputBegin[output]; k < outputBegin[output + 1]; ++k) {
+                    int p = outputPatterns[k];
+                    size_t start = i + 1 - patternLengths[p];
+                    uint8_t anchors = hasAnchors ? patternAnchors[p] : uint8_t(AnchorNone);
+                    if (anchors != AnchorNone) {
+                        int before = start == 0 ? -1 : static_cast<unsigned char>(text[start - 1]);
+                        int after = i + 1 < text.size() ? static_cast<unsigned char>(text[i + 1]) : -1;
+                        if (!startAnchorsHold(anchors, before) || !endAnchorsHold(anchors, after)) {
+                            continue;
+                        }
+                    }
+                    onMatch(Match{p, start, i, patternPayloads[p]});
+                }
+            }
+        }
+    }
+};
+
+// Converts string patterns to the byte sequences CompiledAutomaton takes.
+inline vector<vector<uint8_t>> toBytePatterns(const vector<string>& patterns) {
+    vector<vector<uint8_t>> bytes;
+    bytes.reserve(patterns.size());
+    for (const string& pattern : patterns) {
+        bytes.emplace_back(pattern.begin(), pattern.end());
+    }
+    return bytes;
+}
+
+// Chunk size for reading inputs that cannot be memory-mapped (pipes, sockets, ttys).
+const size_t kReadChunkSize = 256 * 1024;
+// Mapped files are handed out in windows of this size so consumers can stop early.
+const size_t kMappedWindowSize = 4 * 1024 * 1024;
+
+// readChunks() for inputs that cannot be mapped: read() into one reused buffer.
+template <typename ChunkFn>
+bool readChunksBuffered(int fd, ChunkFn& onChunk) {
+    vector<char> buffer(kReadChunkSize);
+    while (true) {
+        ssize_t bytesRead = read(fd, buffer.data(), buffer.size());
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (bytesRead == 0 || !onChunk(buffer.data(), static_cast<size_t>(bytesRead))) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Delivers everything readable from an open file descriptor in chunks.
+ *
+ * Regular files are memory-mapped read-only and handed out in place, with the
+ * kernel told to read ahead aggressively (MADV_SEQUENTIAL) and, where the
+ * filesystem supports it, to back the mapping with huge pages (MADV_HUGEPAGE)
+ * to cut TLB misses on large files. Pipes, sockets, anything mmap() refuses
+ * and descriptors not at offset 0 (e.g. a partly consumed redirected stdin)
+ * fall back to buffered reads. Either way reading starts at the current
+ * offset and leaves it past the last byte delivered.
+ *
+ * A mapped file that shrinks while it is being read is an error: the size
+ * is checked before each window, and what is still there is delivered first.
+ * Truncation racing with the window being read still raises SIGBUS, as it
+ * does for any reader of a mapped file.
+ *
+ * @param fd A readable file descriptor; it is not closed.
+ * @param onChunk Callable invoked as onChunk(const char* data, size_t size) for
+ *                consecutive chunks; returning false stops reading. The data is
+ *                only valid during the call.
+ * @return false if the input could not be read or was truncated.
+ */
+template <typename ChunkFn>
+bool readChunks(int fd, ChunkFn&& onChunk) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return false;
+    }
+    if (!S_ISREG(info.st_mode) || info.st_size == 0 || lseek(fd, 0, SEEK_CUR) != 0) {
+        // Some special files report size 0 but are readable (e.g. under /proc).
+        return readChunksBuffered(fd, onChunk);
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return readChunksBuffered(fd, onChunk);
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(mapping, size, MADV_HUGEPAGE); // Advisory; ignored where unsupported
+#endif
+
+    const char* data = static_cast<const char*>(mapping);
+    size_t offset = 0;
+    bool truncated = false;
+    while (offset < size && !truncated) {
+        size_t window = min(kMappedWindowSize, size - offset);
+        struct stat now;
+        size_t available = fstat(fd, &now) == 0 ? static_cast<size_t>(now.st_size) : 0;
+        if (available < offset + window) {
+            truncated = true;
+            window = available > offset ? available - offset : 0;
+        }
+        bool more = window == 0 || onChunk(data + offset, window);
+        offset += window;
+        if (!more) {
+            break;
+        }
+    }
+    munmap(mapping, size);
+    lseek(fd, static_cast<off_t>(offset), SEEK_SET);
+    return !truncated;
+}
+
+/**
+ * @brief Scans everything readable from an open file descriptor.
+ *
+ * @param ac An automaton with failure links built.
+ * @param fd A readable file descriptor; it is not closed.
+ * @param onMatch Callable invoked as onMatch(const Match&) with stream offsets.
+ * @return false if the input could not be read.
+ * @see readChunks() for how the input is read.
+ */
+template <typename Callback>
+bool scanFd(const AhoCorasick& ac, int fd, Callback&& onMatch) {
+    ScanState state;
+    bool ok = readChunks(fd, [&](const char* data, size_t size) {
+        ac.scanChunk(state, data, size, onMatch);
+        return true;
+    });
+    ac.finishScan(state, onMatch);
+    return ok;
+}
+
+// Opens `path` for reading, or returns standard input for "-"; -1 on failure.
+inline int openInput(const string& path) {
+    return path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+inline void closeInput(int fd) {
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Scans the file at `path`, or standard input if `path` is "-".
+ *
+ * @return false if the file could not be opened or read.
+ */
+template <typename Callback>
+bool scanFile(const AhoCorasick& ac, const string& path, Callback&& onMatch) {
+    int fd = openInput(path);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = scanFd(ac, fd, onMatch);
+    closeInput(fd);
+    return ok;
+}
+
+/**
+ * @brief A fixed ring of equal-size buffers passed in order from one producer
+ *        thread to one consumer thread.
+ *
+ * The producer fills the slot returned by acquire() and hands it over with
+ * publish(); the consumer reads slots with next() and hands them back with
+ * release(). At most `slots` buffers exist however far the producer runs
+ * ahead. Either side can stop early: close() ends the stream for the
+ * consumer, cancel() makes the producer's acquire() fail.
+ */
+class BufferRing {
+private:
+    size_t slotSize;
+    vector<char> storage;
+    vector<size_t> sizes; // Filled bytes per slot
+    mutex lock;
+    condition_variable changed;
+    size_t produced = 0;  // Slots published so far
+    size_t consumed = 0;  // Slots released so far
+    bool closed = false;
+    bool cancelled = false;
+
+public:
+    BufferRing(size_t slots, size_t slotSize)
+        : slotSize(slotSize), storage(slots * slotSize), sizes(slots) {}
+
+    size_t slotCapacity() const {
+        return slotSize;
+    }
+
+    // Waits for an empty slot; null if the consumer cancelled.
+    char* acquire() {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this]() { return produced - consumed < sizes.size() || cancelled; });
+        if (cancelled) {
+            return nullptr;
+        }
+        return storage.data() + (produced % sizes.size()) * slotSize;
+    }
+
+    // Hands the acquired slot, holding `size` bytes, to the consumer.
+    void publish(size_t size) {
+        lock_guard<mutex> guard(lock);
+        sizes[produced % sizes.size()] = size;
+        ++produced;
+        changed.notify_all();
+    }
+
+    // Ends the stream once the published slots are consumed.
+    void close() {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+        changed.notify_all();
+    }
+
+    // Waits for the next published slot; false at the end of the stream.
+    bool next(const char*& data, size_t& size) {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this]() { return consumed < produced || closed; });
+        if (consumed == produced) {
+            return false;
+        }
+        size_t slot = consumed % sizes.size();
+        data = storage.data() + slot * slotSize;
+        size = sizes[slot];
+        return true;
+    }
+
+    // Returns the slot last obtained from next() to the producer.
+    void release() {
+        lock_guard<mutex> guard(lock);
+        ++consumed;
+        changed.notify_all();
+    }
+
+    // Stops the producer; it sees acquire() fail.
+    void cancel() {
+        lock_guard<mutex> guard(lock);
+        cancelled = true;
+        changed.notify_all();
+    }
+};
+
+// Compressed formats recognized by their magic numbers.
+enum class Compression { None, Gzip, Zstd };
+
+// Bytes detectCompression() needs to tell every format apart (the zstd magic).
+const size_t kMaxMagicLength = 4;
+
+inline Compression detectCompression(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+        return Compression::Gzip;
+    }
+    if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd) {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+// Fills ring slots with a decoder's output, publishing each slot once it is full.
+class RingWriter {
+private:
+    BufferRing& ring;
+    char* slot = nullptr;
+    size_t filled = 0;
+
+public:
+    explicit RingWriter(BufferRing& ring) : ring(ring) {}
+
+    // Free space in the current slot, acquiring one if needed; null if the consumer stopped.
+    char* tail(size_t& room) {
+        if (slot == nullptr) {
+            slot = ring.acquire();
+            filled = 0;
+            if (slot == nullptr) {
+                return nullptr;
+            }
+        }
+        room = ring.slotCapacity() - filled;
+        return slot + filled;
+    }
+
+    void advance(size_t size) {
+        filled += size;
+        if (filled == ring.slotCapacity()) {
+            ring.publish(filled);
+            slot = nullptr;
+        }
+    }
+
+    // Publishes a partly filled slot.
+    void flush() {
+        if (slot != nullptr && filled > 0) {
+            ring.publish(filled);
+            slot = nullptr;
+        }
+    }
+};
+
+/**
+ * @brief Decodes the compressed input on `fd` into `ring`, on the calling
+ *        (producer) thread. Uncompressed input is copied through.
+ *
+ * gzip needs AHO_CORASICK_WITH_ZLIB (link with -lz) and zstd needs
+ * AHO_CORASICK_WITH_ZSTD (link with -lzstd); without them such input fails.
+ * Concatenated gzip members and zstd frames are decoded back to back; zero
+ * bytes after the last gzip member (padding left by tape or block-device
+ * writers) end the input, as gzip itself accepts them. The format is decided
+ * once kMaxMagicLength bytes are read, however the input is split into chunks.
+ *
+ * @return false if the input could not be read, is corrupt or truncated, or
+ *         uses a format this build cannot decode. Not reported if the consumer
+ *         cancelled.
+ */
+inline bool decompressInto(int fd, BufferRing& ring) {
+    RingWriter writer(ring);
+    Compression compression = Compression::None;
+    string head; // Input held back until the format is known
+    bool detected = false;
+    bool ok = true;
+    bool complete = true; // Whether the input so far ends on a stream boundary
+    bool stopped = false;
+
+#ifdef AHO_CORASICK_WITH_ZLIB
+    z_stream zlibStream;
+    memset(&zlibStream, 0, sizeof(zlibStream));
+    bool zlibReady = false;
+    bool padded = false; // Whether zero padding followed the last gzip member
+#endif
+#ifdef AHO_CORASICK_WITH_ZSTD
+    ZSTD_DCtx* zstdContext = nullptr;
+#endif
+
+    auto detect = [&]() {
+        detected = true;
+        compression = detectCompression(head.data(), head.size());
+#ifdef AHO_CORASICK_WITH_ZLIB
+        // 15 + 32: the largest window, with gzip/zlib header detection.
+        zlibReady = compression == Compression::Gzip && inflateInit2(&zlibStream, 15 + 32) == Z_OK;
+#endif
+#ifdef AHO_CORASICK_WITH_ZSTD
+        if (compression == Compression::Zstd) {
+            zstdContext = ZSTD_createDCtx();
+        }
+#endif
+    };
+
+    auto consume = [&](const char* data, size_t size) {
+        size_t room = 0;
+        if (compression == Compression::None) {
+            while (size > 0) {
+                char* out = writer.tail(room);
+                if (out == nullptr) {
+                    stopped = true;
+                    return false;
+                }
+                size_t n = min(room, size);
+                memcpy(out, data, n);
+                writer.advance(n);
+                data += n;
+                size -= n;
+            }
+            return true;
+        }
+
+#ifdef AHO_CORASICK_WITH_ZLIB
+        if (compression == Compression::Gzip && zlibReady) {
+            zlibStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            zlibStream.avail_in = static_cast<uInt>(size);
+            // Keep going while input is left or the last call filled the output.
+            do {
+                // No member starts with a zero byte, so one after a member is padding.
+                if (complete && zlibStream.avail_in > 0 && (padded || zlibStream.next_in[0] == 0)) {
+                    padded = true;
+                    Bytef* end = zlibStream.next_in + zlibStream.avail_in;
+                    ok = find_if(zlibStream.next_in, end, [](Bytef byte) { return byte != 0; }) == end;
+                    return ok;
+                }
+                char* out = writer.tail(room);
+                if (out == nullptr) {
+                    stopped = true;
+                    return false;
+                }
+                if (complete && zlibStream.avail_in > 0) {
+                    complete = false;
+                }
+                zlibStream.next_out = reinterpret_cast<Bytef*>(out);
+                zlibStream.avail_out = static_cast<uInt>(room);
+                int status = inflate(&zlibStream, Z_NO_FLUSH);
+                writer.advance(room - zlibStream.avail_out);
+                if (status == Z_STREAM_END) {
+                    complete = true;
+                    inflateReset(&zlibStream); // Another member may follow
+                } else if (status == Z_BUF_ERROR && zlibStream.avail_in == 0) {
+                    break; // Needs more input
+                } else if (status != Z_OK) {
+                    ok = false;
+                    return false;
+                }
+            } while (zlibStream.avail_in > 0 || zlibStream.avail_out == 0);
+            return true;
+        }
+#endif
+#ifdef AHO_CORASICK_WITH_ZSTD
+        if (compression == Compression::Zstd && zstdContext != nullptr) {
+            ZSTD_inBuffer in = {data, size, 0};
+            ZSTD_outBuffer out;
+            do {
+                char* space = writer.tail(room);
+                if (space == nullptr) {
+                    stopped = true;
+                    return false;
+                }
+                out = {space, room, 0};
+                size_t hint = ZSTD_decompressStream(zstdContext, &out, &in);
+                writer.advance(out.pos);
+                if (ZSTD_isError(hint)) {
+                    ok = false;
+                    return false;
+                }
+                complete = hint == 0; // 0: a frame just ended
+            } while (in.pos < in.size || out.pos == out.size);
+            return true;
+        }
+#endif
+        ok = false; // A format this build cannot decode
+        return false;
+    };
+
+    bool readOk = readChunks(fd, [&](const char* data, size_t size) {
+        if (!detected) {
+            size_t taken = min(size, kMaxMagicLength - head.size());
+            head.append(data, taken);
+            data += taken;
+            size -= taken;
+            if (head.size() < kMaxMagicLength) {
+                return true;
+            }
+            detect();
+            if (!consume(head.data(), head.size())) {
+                return false;
+            }
+        }
+        return size == 0 || consume(data, size);
+    });
+    if (readOk && !detected) { // Input shorter than any magic
+        detect();
+        consume(head.data(), head.size());
+    }
+
+#ifdef AHO_CORASICK_WITH_ZLIB
+    if (zlibReady) {
+        inflateEnd(&zlibStream);
+    }
+#endif
+#ifdef AHO_CORASICK_WITH_ZSTD
+    ZSTD_freeDCtx(zstdContext);
+#endif
+    writer.flush();
+    ring.close();
+    return stopped || (readOk && ok && complete);
+}
+
+// Ring geometry of readDecompressedChunks(): enough slots for the decoder to stay ahead.
+const size_t kDecompressRingSlots = 4;
+const size_t kDecompressSlotSize = 256 * 1024;
+
+/**
+ * @brief Like readChunks(), but delivers the decompressed content of a gzip
+ *        or zstd input (uncompressed input is passed through).
+ *
+ * A separate thread decodes into a ring of fixed-size buffers while the
+ * calling thread consumes them, so the decompressed stream is never held in
+ * memory as a whole and decoding overlaps whatever onChunk does.
+ *
+ * @param onChunk Called on the calling thread as onChunk(const char* data,
+ *                size_t size); returning false stops decoding.
+ * @return false if the input could not be read or decoded.
+ * @see decompressInto() for the supported formats.
+ */
+template <typename ChunkFn>
+bool readDecompressedChunks(int fd, ChunkFn&& onChunk) {
+    BufferRing ring(kDecompressRingSlots, kDecompressSlotSize);
+    bool decoded = true;
+    thread decoder([&]() { decoded = decompressInto(fd, ring); });
+
+    const char* data;
+    size_t size;
+    while (ring.next(data, size)) {
+        bool more = onChunk(data, size);
+        ring.release();
+        if (!more) {
+            ring.cancel();
+            break;
+        }
+    }
+    decoder.join();
+    return decoded;
+}
+
+/**
+ * @brief Scans the decompressed content of a gzip or zstd input.
+ *
+ * @return false if the input could not be read or decoded; matches found
+ *         before the error have been reported.
+ */
+template <typename Callback>
+bool scanCompressedFd(const AhoCorasick& ac, int fd, Callback&& onMatch) {
+    ScanState state;
+    bool ok = readDecompressedChunks(fd, [&](const char* data, size_t size) {
+        ac.scanChunk(state, data, size, onMatch);
+        return true;
+    });
+    ac.finishScan(state, onMatch);
+    return ok;
+}
+
+// A file to scan, with the command-line operand it was found under.
+struct InputFile {
+    string path;
+    size_t size;      // Bytes, for scheduling; 0 if unknown
+    size_t rootIndex; // Index of the operand naming it or a directory above it
+};
+
+#ifdef AHO_CORASICK_HAVE_IO_URING
+/**
+ * @brief Minimal io_uring submission and completion rings over the raw
+ *        system calls, enough to queue reads and reap their results.
+ *
+ * Used by a single thread. init() fails where the kernel lacks io_uring or
+ * a sandbox forbids it; callers then fall back to pread().
+ */
+class IoUring {
+private:
+    int ringFd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    void* sqeArea = MAP_FAILED;
+    size_t sqeAreaSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned unsubmitted = 0; // Queued entries not yet passed to io_uring_enter()
+
+    // The cleared entry at the submission queue tail, or null if the queue is full.
+    io_uring_sqe* nextEntry() {
+        unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            return nullptr;
+        }
+        io_uring_sqe* sqe = &sqes[tail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Makes the entry returned by nextEntry() visible to the kernel.
+    void commitEntry() {
+        unsigned tail = *sqTail;
+        sqArray[tail & sqMask] = tail & sqMask;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted;
+    }
+
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqeArea != MAP_FAILED) munmap(sqeArea, sqeAreaSize);
+        if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqeAreaSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_SQ_RING);
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_CQ_RING);
+        sqeArea = mmap(nullptr, sqeAreaSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                       IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqeArea == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqes = static_cast<io_uring_sqe*>(sqeArea);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Registers buffers for IORING_OP_READ_FIXED; fails if they exceed RLIMIT_MEMLOCK.
+    bool registerBuffers(const vector<iovec>& buffers) {
+        return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers.data(),
+                       static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    /**
+     * @brief Queues a read of `size` bytes at `offset` of `fd` into `buffer`.
+     *
+     * @param fixedIndex Index of the registered buffer containing `buffer`, or -1.
+     * @return false if the submission queue is full.
+     */
+    bool queueRead(int fd, char* buffer, unsigned size, uint64_t offset, int fixedIndex, uint64_t userData) {
+        io_uring_sqe* sqe = nextEntry();
+        if (sqe == nullptr) {
+            return false;
+        }
+        sqe->opcode = fixedIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = size;
+        sqe->off = offset;
+        sqe->buf_index = fixedIndex >= 0 ? static_cast<uint16_t>(fixedIndex) : 0;
+        sqe->user_data = userData;
+        commitEntry();
+        return true;
+    }
+
+    /**
+     * @brief Queues the cancellation of the request queued with user data `target`.
+     *
+     * The cancelled request still completes, with -ECANCELED if it had not
+     * finished, and the cancellation itself completes with `userData`.
+     * @return false if the submission queue is full.
+     */
+    bool queueCancel(uint64_t target, uint64_t userData) {
+        io_uring_sqe* sqe = nextEntry();
+        if (sqe == nullptr) {
+            return false;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target;
+        sqe->user_data = userData;
+        commitEntry();
+        return true;
+    }
+
+    // Submits the queued reads and waits until at least `waitFor` completions are available.
+    bool submitAndWait(unsigned waitFor) {
+        while (true) {
+            long submitted = syscall(__NR_io_uring_enter, ringFd, unsubmitted, waitFor,
+                                     waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted >= 0) {
+                unsubmitted -= static_cast<unsigned>(submitted);
+                return true;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    // Takes the oldest completion, if any: its user data and its result (bytes or -errno).
+    bool popCompletion(uint64_t& userData, int& result) {
+        unsigned head = *cqHead;
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        const io_uring_cqe& cqe = cqes[head & cqMask];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+#endif
+
+// Tuning of ingestFiles().
+struct IngestOptions {
+    unsigned queueDepth = 32;      // Reads kept in flight
+    size_t bufferSize = 1 << 20;   // Files up to this size are read ahead; larger ones are mapped by the scanner
+    unsigned readerThreads = 4;    // Size of the pread() pool used without io_uring
+    bool useIoUring = true;        // false forces the pread() pool
+};
+
+/**
+ * @brief Reads many files ahead of the threads that scan them.
+ *
+ * An ingestion stage reads whole files into a fixed pool of buffers while
+ * `numWorkers` scanning threads consume the completed buffers, so I/O and
+ * scanning overlap. With io_uring, one thread keeps up to `queueDepth` reads
+ * in flight, into registered buffers when RLIMIT_MEMLOCK allows; without it
+ * (old kernels, sandboxes, non-Linux builds) a pool of threads issues
+ * pread() calls instead.
+ *
+ * Files larger than a buffer, empty or special files, and files the stage
+ * fails to open or read are handed over unread, so the worker maps or reads
+ * them itself (and reports any error).
+ *
+ * @param files The files; ingestion starts in the order of `order`.
+ * @param order Indices into `files`, e.g. largest first.
+ * @param admit Called as admit(size_t index, bool wait) before ingestion of
+ *              file `index` starts, in the order of `order`; returns whether
+ *              it may start, blocking until it may if `wait`. Lets the caller
+ *              bound how far ingestion runs ahead of it.
+ * @param onFile Called on a worker thread as
+ *               onFile(unsigned worker, size_t index, const char* data, size_t size)
+ *               with worker < numWorkers; data is null if the file was not
+ *               read, and valid only during the call.
+ * @return true if io_uring was used.
+ */
+template <typename Admit, typename OnFile>
+bool ingestFiles(const vector<InputFile>& files, const vector<size_t>& order, unsigned numWorkers,
+                 const IngestOptions& options, const Admit& admit, const OnFile& onFile) {
+    // A file the ingestion stage is done with; buffer -1 means it was not read.
+    struct Ready {
+        size_t index;
+        int buffer;
+        size_t size;
+    };
+
+    size_t bufferSize = options.bufferSize;
+    int bufferCount = static_cast<int>(options.queueDepth + max(1u, numWorkers));
+    unique_ptr<char[]> storage(new char[bufferSize * bufferCount]);
+    auto bufferData = [&](int buffer) { return storage.get() + buffer * bufferSize; };
+
+    mutex lock;
+    condition_variable readyChanged;
+    condition_variable freeChanged;
+    deque<Ready> ready;
+    vector<int> freeBuffers;
+    for (int buffer = bufferCount - 1; buffer >= 0; --buffer) {
+        freeBuffers.push_back(buffer);
+    }
+    bool ingestionDone = false;
+
+    auto publish = [&](size_t index, int buffer, size_t size) {
+        lock_guard<mutex> guard(lock);
+        ready.push_back({index, buffer, size});
+        readyChanged.notify_one();
+    };
+    // Takes a free buffer, waiting for one if `wait`; -1 if none.
+    auto takeBuffer = [&](bool wait) {
+        unique_lock<mutex> guard(lock);
+        if (wait) {
+            freeChanged.wait(guard, [&]() { return !freeBuffers.empty(); });
+        } else if (freeBuffers.empty()) {
+            return -1;
+        }
+        int buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        return buffer;
+    };
+    auto releaseBuffer = [&](int buffer) {
+        lock_guard<mutex> guard(lock);
+        freeBuffers.push_back(buffer);
+        freeChanged.notify_one();
+    };
+    auto readAhead = [&](const InputFile& file) {
+        return file.path != "-" && file.size > 0 && file.size <= bufferSize;
+    };
+
+    // Reads a whole file with pread(); false on errors or if it changed size.
+    auto preadFile = [&](const InputFile& file, int buffer) {
+        int fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        size_t done = 0;
+        while (done < file.size) {
+            ssize_t n = pread(fd, bufferData(buffer) + done, file.size - done, done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        close(fd);
+        return done == file.size;
+    };
+
+    auto preadPool = [&]() {
+        atomic<size_t> next{0};
+        auto reader = [&]() {
+            for (size_t k = next++; k < order.size(); k = next++) {
+                const InputFile& file = files[order[k]];
+                admit(order[k], true);
+                if (!readAhead(file)) {
+                    publish(order[k], -1, 0);
+                    continue;
+                }
+                int buffer = takeBuffer(true);
+                if (preadFile(file, buffer)) {
+                    publish(order[k], buffer, file.size);
+                } else {
+                    releaseBuffer(buffer);
+                    publish(order[k], -1, 0);
+                }
+            }
+        };
+        vector<thread> readers;
+        for (unsigned t = 0; t < max(1u, options.readerThreads); ++t) {
+            readers.emplace_back(reader);
+        }
+        for (thread& t : readers) {
+            t.join();
+        }
+    };
+
+    bool usedIoUring = false;
+    bool leakStorage = false;
+    auto ingest = [&]() {
+#ifdef AHO_CORASICK_HAVE_IO_URING
+        IoUring ring;
+        if (options.useIoUring && ring.init(options.queueDepth)) {
+            usedIoUring = true;
+            vector<iovec> iovecs(bufferCount);
+            for (int buffer = 0; buffer < bufferCount; ++buffer) {
+                iovecs[buffer] = {bufferData(buffer), bufferSize};
+            }
+            bool fixed = ring.registerBuffers(iovecs);
+
+            // Reads in flight, by buffer; a short read is resubmitted for the rest.
+            struct InFlight {
+                size_t index;
+                int fd;
+                size_t done;
+                bool active;
+            };
+            vector<InFlight> inFlight(bufferCount, InFlight{0, -1, 0, false});
+            auto queue = [&](int buffer) {
+                const InputFile& file = files[inFlight[buffer].index];
+                size_t done = inFlight[buffer].done;
+                return ring.queueRead(inFlight[buffer].fd, bufferData(buffer) + done,
+                                      static_cast<unsigned>(file.size - done), done, fixed ? buffer : -1, buffer);
+            };
+            auto finish = [&](int buffer, bool ok) {
+                inFlight[buffer].active = false;
+                close(inFlight[buffer].fd);
+                size_t index = inFlight[buffer].index;
+                if (ok) {
+                    publish(index, buffer, files[index].size);
+                } else {
+                    releaseBuffer(buffer);
+                    publish(index, -1, 0);
+                }
+            };
+
+            size_t next = 0;
+            unsigned outstanding = 0;
+            while (next < order.size() || outstanding > 0) {
+                while (next < order.size() && outstanding < options.queueDepth) {
+                    size_t index = order[next];
+                    // Like buffers, wait only when no completion is pending.
+                    if (!admit(index, outstanding == 0)) {
+                        break;
+                    }
+                    if (!readAhead(files[index])) {
+                        publish(index, -1, 0);
+                        ++next;
+                        continue;
+                    }
+                    // Block for a buffer only when no completion could free one.
+                    int buffer = takeBuffer(outstanding == 0);
+                    if (buffer < 0) {
+                        break;
+                    }
+                    int fd = open(files[index].path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (fd < 0) {
+                        releaseBuffer(buffer);
+                        publish(index, -1, 0);
+                        ++next;
+                        continue;
+                    }
+                    ++next;
+                    inFlight[buffer] = {index, fd, 0, true};
+                    if (!queue(buffer)) {
+                        finish(buffer, false);
+                        continue;
+                    }
+                    ++outstanding;
+                }
+                if (!ring.submitAndWait(outstanding > 0 ? 1 : 0)) {
+                    break;
+                }
+
+                uint64_t userData;
+                int result;
+                while (ring.popCompletion(userData, result)) {
+                    int buffer = static_cast<int>(userData);
+                    InFlight& read = inFlight[buffer];
+                    size_t size = files[read.index].size;
+                    if (result > 0 && read.done + result < size) {
+                        read.done += result;
+                        if (queue(buffer)) {
+                            continue;
+                        }
+                    }
+                    --outstanding;
+                    finish(buffer, result >= 0 && read.done + result == size);
+                }
+            }
+            // Only reached early if io_uring_enter() failed. Reads still in
+            // flight may write into their buffers at any time, so cancel them
+            // and wait for their completions before handing the rest over
+            // unread.
+            if (outstanding > 0) {
+                const uint64_t cancelTag = ~uint64_t(0);
+                for (int buffer = 0; buffer < bufferCount; ++buffer) {
+                    if (inFlight[buffer].active) {
+                        ring.queueCancel(static_cast<uint64_t>(buffer), cancelTag);
+                    }
+                }
+                uint64_t userData;
+                int result;
+                while (outstanding > 0 && ring.submitAndWait(1)) {
+                    while (ring.popCompletion(userData, result)) {
+                        if (userData != cancelTag) {
+                            --outstanding;
+                            finish(static_cast<int>(userData), false);
+                        }
+                    }
+                }
+                // Should the ring stay unusable, the kernel may still own some
+                // buffers: never free them.
+                leakStorage = outstanding > 0;
+            }
+            for (int buffer = 0; buffer < bufferCount; ++buffer) {
+                if (inFlight[buffer].active) {
+                    inFlight[buffer].active = false;
+                    close(inFlight[buffer].fd);
+                    publish(inFlight[buffer].index, -1, 0);
+                }
+            }
+            for (; next < order.size(); ++next) {
+                publish(order[next], -1, 0);
+            }
+        } else {
+            preadPool();
+        }
+#else
+        preadPool();
+#endif
+        lock_guard<mutex> guard(lock);
+        ingestionDone = true;
+        readyChanged.notify_all();
+    };
+
+    auto worker = [&](unsigned id) {
+        while (true) {
+            Ready item;
+            {
+                unique_lock<mutex> guard(lock);
+                readyChanged.wait(guard, [&]() { return !ready.empty() || ingestionDone; });
+                if (ready.empty()) {
+                    return;
+                }
+                item = ready.front();
+                ready.pop_front();
+            }
+            if (item.buffer < 0) {
+                onFile(id, item.index, nullptr, 0);
+                continue;
+            }
+            onFile(id, item.index, bufferData(item.buffer), item.size);
+            releaseBuffer(item.buffer);
+        }
+    };
+
+    thread ingestion(ingest);
+    vector<thread> workers;
+    for (unsigned t = 1; t < max(1u, numWorkers); ++t) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (thread& t : workers) {
+        t.join();
+    }
+    ingestion.join();
+    if (leakStorage) {
+        storage.release();
+    }
+    return usedIoUring;
+}
+
+/**
+ * @brief Publishes immutable AhoCorasick snapshots to concurrent readers.
+ *
+ * A control thread builds a new automaton on the side, calls buildFailureLinks()
+ * and hands it over with publish(). Scanner threads register once for a reader
+ * slot and pin the current snapshot around each search(). Pinning never takes a
+ * lock: it stores the snapshot pointer into the reader's hazard slot and
+ * re-reads the published pointer to validate it. A replaced snapshot is retired
+ * and deleted only once no hazard slot points at it any more.
+ */
+class AutomatonHolder {
+private:
+    // One slot per registered reader, padded so readers do not share cache lines.
+    struct alignas(64) ReaderSlot {
+        atomic<const AhoCorasick*> hazard{nullptr};
+        atomic<bool> inUse{false};
+    };
+
+    atomic<const AhoCorasick*> current;
+    vector<ReaderSlot> slots;
+
+    mutex writerMutex;                 // Serializes publish() and reclaim()
+    vector<const AhoCorasick*> retired; // Replaced snapshots awaiting reclamation
+
+    // Deletes every retired snapshot that no reader has pinned. Caller holds writerMutex.
+    void reclaimLocked() {
+        vector<const AhoCorasick*> pinned;
+        for (const ReaderSlot& slot : slots) {
+            const AhoCorasick* p = slot.hazard.load();
+            if (p != nullptr) {
+                pinned.push_back(p);
+            }
+        }
+
+        size_t kept = 0;
+        for (const AhoCorasick* snapshot : retired) {
+            if (find(pinned.begin(), pinned.end(), snapshot) != pinned.end()) {
+                retired[kept++] = snapshot;
+            } else {
+                delete snapshot;
+            }
+        }
+        retired.resize(kept);
+    }
+
+public:
+    /**
+     * @param initial The first snapshot to serve; may be null until the first publish().
+     * @param maxReaders The number of reader slots, i.e. how many threads may be
+     *        registered at the same time.
+     */
+    explicit AutomatonHolder(unique_ptr<const AhoCorasick> initial = nullptr, int maxReaders = 64)
+        : current(initial.release()), slots(maxReaders) {}
+
+    // Readers must have unregistered before the holder is destroyed.
+    ~AutomatonHolder() {
+        delete current.load();
+        for (const AhoCorasick* snapshot : retired) {
+            delete snapshot;
+        }
+    }
+
+    AutomatonHolder(const AutomatonHolder&) = delete;
+    AutomatonHolder& operator=(const AutomatonHolder&) = delete;
+
+    /**
+     * @brief Claims a reader slot for the calling thread.
+     *
+     * @return The slot index to pass to pin()/unpin(), or -1 if all slots are taken.
+     */
+    int registerReader() {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            bool expected = false;
+            if (slots[i].inUse.compare_exchange_strong(expected, true)) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Releases a slot obtained from registerReader(). The slot must not be pinned.
+    void unregisterReader(int slot) {
+        slots[slot].hazard.store(nullptr);
+        slots[slot].inUse.store(false);
+    }
+
+    /**
+     * @brief Pins the current snapshot for the reader owning the given slot.
+     *
+     * The returned automaton stays alive until the same slot calls unpin() or
+     * pin() again, even if a newer snapshot is published in the meantime.
+     *
+     * @param slot A slot index returned by registerReader().
+     * @return The pinned snapshot, or nullptr if nothing has been published yet.
+     *
+     * @note Lock-free: the loop only repeats if a publish() races with the pin.
+     */
+    const AhoCorasick* pin(int slot) {
+        atomic<const AhoCorasick*>& hazard = slots[slot].hazard;
+        const AhoCorasick* snapshot = current.load();
+        while (true) {
+            hazard.store(snapshot);
+            const AhoCorasick* recheck = current.load();
+            if (recheck == snapshot) {
+                return snapshot;
+            }
+            snapshot = recheck;
+        }
+    }
+
+    // Ends the reader's use of its pinned snapshot.
+    void unpin(int slot) {
+        slots[slot].hazard.store(nullptr);
+    }
+
+    /**
+     * @brief Atomically replaces the served snapshot.
+     *
+     * Readers that pinned the previous snapshot keep using it; it is deleted by
+     * this or a later publish()/reclaim() once all of them have unpinned.
+     *
+     * @param next A fully built automaton (buildFailureLinks() already called).
+     */
+    void publish(unique_ptr<const AhoCorasick> next) {
+        lock_guard<mutex> lock(writerMutex);
+        const AhoCorasick* previous = current.exchange(next.release());
+        if (previous != nullptr) {
+            retired.push_back(previous);
+        }
+        reclaimLocked();
+    }
+
+    // Frees retired snapshots that are no longer pinned.
+    void reclaim() {
+        lock_guard<mutex> lock(writerMutex);
+        reclaimLocked();
+    }
+
+    // Number of replaced snapshots still waiting for their readers to finish.
+    size_t retiredCount() {
+        lock_guard<mutex> lock(writerMutex);
+        return retired.size();
+    }
+};
+
+/**
+ * @brief RAII helper that pins a snapshot for the lifetime of a scan.
+ */
+class SnapshotGuard {
+private:
+    AutomatonHolder& holder;
+    int slot;
+    const AhoCorasick* snapshot;
+
+public:
+    SnapshotGuard(AutomatonHolder& holder, int slot)
+        : holder(holder), slot(slot), snapshot(holder.pin(slot)) {}
+
+    ~SnapshotGuard() {
+        holder.unpin(slot);
+    }
+
+    SnapshotGuard(const SnapshotGuard&) = delete;
+    SnapshotGuard& operator=(const SnapshotGuard&) = delete;
+
+    const AhoCorasick* get() const { return snapshot; }
+    const AhoCorasick& operator*() const { return *snapshot; }
+    const AhoCorasick* operator->() const { return snapshot; }
+};
+
+/**
+ * @brief Options of the grep command, a multi-pattern fixed-string grep.
+ *
+ * aho_corasick grep [-c | -l] [-a] [-i] [-w] [-U] [-z] [-j THREADS] (-f FILE | -e PATTERN)... [PATH...]
+ * aho_corasick grep [OPTIONS] PATTERN [PATH...]
+ *
+ * Prints path:line:offset:pattern for every match, where offset is the byte
+ * offset of the match in the file. Directories are searched recursively,
+ * without following symbolic links, and "-" (the default) is standard input.
+ * Binary files, those with a NUL byte near the start, are searched but only
+ * reported as "Binary file PATH matches" unless -a; -c and -l treat them like
+ * any other file, and -c prints a count for every file, matched or not. -U
+ * cannot be combined with -z. Exits with 0 if anything matched, 1 if nothing
+ * did and 2 on errors.
+ */
+struct GrepOptions {
+    enum class Mode { Matches, Count, FilesWithMatches };
+
+    Mode mode = Mode::Matches;   // -c: matching line count per file; -l: names of matching files
+    bool ignoreCase = false;     // -i: ASCII case-insensitive
+    bool wordMatch = false;      // -w: patterns only match whole words
+    bool scanBinary = false;     // -a: search binary files as text
+    bool ingest = false;         // -U: read files ahead through ingestFiles() (io_uring where available)
+    bool decompress = false;     // -z: search the content of gzip/zstd compressed inputs
+    unsigned numThreads = max(1u, thread::hardware_concurrency()); // -j
+    vector<string> patterns;     // -e, or one per line of each -f file; split at newlines, empty ones ignored
+    vector<string> paths;
+};
+
+// Reads one pattern per line; a trailing '\r' is dropped.
+bool readPatternFile(const string& path, vector<string>& patterns) {
+    ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        patterns.push_back(line);
+    }
+    return true;
+}
+
+// Parses argv[2..argc) into `options`; prints a message and returns false on errors.
+bool parseGrepArgs(int argc, char** argv, GrepOptions& options) {
+    bool havePatterns = false;
+    vector<string> operands;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--") {
+            operands.insert(operands.end(), argv + i + 1, argv + argc);
+            break;
+        }
+        if (arg.size() < 2 || arg[0] != '-') {
+            operands.push_back(arg);
+            continue;
+        }
+        for (size_t k = 1; k < arg.size(); ++k) {
+            char flag = arg[k];
+            if (flag == 'c') {
+                options.mode = GrepOptions::Mode::Count;
+            } else if (flag == 'l') {
+                options.mode = GrepOptions::Mode::FilesWithMatches;
+            } else if (flag == 'i') {
+                options.ignoreCase = true;
+            } else if (flag == 'w') {
+                options.wordMatch = true;
+            } else if (flag == 'a') {
+                options.scanBinary = true;
+            } else if (flag == 'U') {
+                options.ingest = true;
+            } else if (flag == 'z') {
+                options.decompress = true;
+            } else if (flag == 'e' || flag == 'f' || flag == 'j') {
+                // The value is the rest of this argument or the next one.
+                string value;
+                if (k + 1 < arg.size()) {
+                    value = arg.substr(k + 1);
+                } else if (i + 1 < argc) {
+                    value = argv[++i];
+                } else {
+                    cerr << argv[0] << ": option -" << flag << " needs a value" << endl;
+                    return false;
+                }
+                if (flag == 'e') {
+                    options.patterns.push_back(value);
+                } else if (flag == 'f') {
+                    if (!readPatternFile(value, options.patterns)) {
+                        cerr << argv[0] << ": " << value << ": cannot read pattern file" << endl;
+                        return false;
+                    }
+                } else {
+                    options.numThreads = max(1, atoi(value.c_str()));
+                }
+                havePatterns = havePatterns || flag != 'j';
+                break;
+            } else {
+                cerr << argv[0] << ": unknown option -" << flag << endl;
+                return false;
+            }
+        }
+    }
+
+    if (!havePatterns) {
+        if (operands.empty()) {
+            cerr << "usage: " << argv[0]
+                 << " grep [-c | -l] [-a] [-i] [-w] [-U] [-z] [-j THREADS] (-f FILE | -e PATTERN | PATTERN) [PATH...]" << endl;
+            return false;
+        }
+        options.patterns.push_back(operands.front());
+        operands.erase(operands.begin());
+    }
+    if (options.ingest && options.decompress) {
+        cerr << argv[0] << ": -U cannot be combined with -z" << endl;
+        return false;
+    }
+    // As in grep, a pattern containing newlines is one pattern per line.
+    vector<string> lines;
+    for (const string& pattern : options.patterns) {
+        size_t begin = 0;
+        for (size_t end = pattern.find('\n'); end != string::npos; begin = end + 1, end = pattern.find('\n', begin)) {
+            lines.push_back(pattern.substr(begin, end - begin));
+        }
+        lines.push_back(pattern.substr(begin));
+    }
+    options.patterns.swap(lines);
+    options.patterns.erase(remove(options.patterns.begin(), options.patterns.end(), string()),
+                           options.patterns.end());
+    options.paths = operands.empty() ? vector<string>{"-"} : operands;
+    return true;
+}
+
+// Builds the automaton for the grep command; repeated patterns are reported once.
+unique_ptr<AhoCorasick> buildGrepAutomaton(const GrepOptions& options) {
+    AhoCorasickOptions acOptions;
+    acOptions.caseFolding = options.ignoreCase ? CaseFolding::Ascii : CaseFolding::None;
+    acOptions.deduplicate = true;
+    if (!options.wordMatch) {
+        return make_unique<AhoCorasick>(options.patterns, false, acOptions);
+    }
+    auto ac = make_unique<AhoCorasick>(acOptions);
+    for (const string& pattern : options.patterns) {
+        ac->addPattern(pattern, AnchorWord);
+    }
+    ac->buildFailureLinks(options.numThreads);
+    return ac;
+}
+
+/**
+ * @brief Counts newlines up to the matches of a stream, which arrive in order
+ *        of their end offsets.
+ *
+ * parseGrepArgs() splits patterns at newlines, so a match's line is the line
+ * of its end.
+ */
+class LineCounter {
+private:
+    size_t counted = 0;  // Stream offset up to which newlines are counted
+    size_t newlines = 0; // Newlines in [0, counted)
+
+public:
+    // The 1-based line of the byte at `position`, given the chunk at stream
+    // offset `base`. A position before the chunk must be on the line the
+    // previous chunk ended on, which holds for matches reported late.
+    size_t lineAt(size_t position, const char* data, size_t base) {
+        if (position > counted) {
+            newlines += count(data + (counted - base), data + (position - base), '\n');
+            counted = position;
+        }
+        return newlines + 1;
+    }
+
+    // Counts the rest of the chunk at stream offset `base`.
+    void advance(const char* data, size_t size, size_t base) {
+        lineAt(base + size, data, base);
+    }
+};
+
+// Leading bytes checked for NUL when deciding whether an input is binary.
+const size_t kBinaryProbeSize = 8192;
+
+/**
+ * @brief Collects the output of one grep input in memory.
+ *
+ * Output is appended to `out`; `flush(out)` may be called to drain it while
+ * the input is still being scanned. `state` is the calling worker's scan
+ * state, reused across its inputs. If `loaded` is given it holds the whole
+ * content of `path`, already read by the ingestion stage, and the file is
+ * not opened.
+ *
+ * @return false if the input could not be read.
+ */
+template <typename Flush>
+bool grepInput(const AhoCorasick& ac, const GrepOptions& options, const string& path, ScanState& state,
+               string& out, bool& matched, const Flush& flush, const string_view* loaded = nullptr) {
+    const string& name = path == "-" ? string("(standard input)") : path;
+    bool binary = false;
+    LineCounter lines;
+    size_t matchingLines = 0;
+    size_t lastLine = 0;
+    const char* chunkData = nullptr;
+    size_t chunkBase = 0;
+    auto onMatch = [&](const Match& match) {
+        matched = true;
+        if (options.mode == GrepOptions::Mode::FilesWithMatches ||
+            (options.mode == GrepOptions::Mode::Matches && binary)) {
+            return;
+        }
+        size_t line = lines.lineAt(match.endPosition, chunkData, chunkBase);
+        if (options.mode == GrepOptions::Mode::Count) {
+            matchingLines += line != lastLine;
+            lastLine = line;
+            return;
+        }
+        string_view pattern = ac.getPattern(match.patternIndex);
+        out += name;
+        out += ':';
+        out += to_string(line);
+        out += ':';
+        out += to_string(match.startPosition);
+        out += ':';
+        out.append(pattern.data(), pattern.size());
+        out += '\n';
+    };
+
+    auto onChunk = [&](const char* data, size_t size) {
+        if (chunkBase == 0 && !options.scanBinary && memchr(data, 0, min(size, kBinaryProbeSize))) {
+            binary = true;
+        }
+        chunkData = data;
+        ac.scanChunk(state, data, size, onMatch);
+        if (matched && (options.mode == GrepOptions::Mode::FilesWithMatches ||
+                        (options.mode == GrepOptions::Mode::Matches && binary))) {
+            return false; // The answer is known; skip the rest of the file
+        }
+        lines.advance(data, size, chunkBase);
+        chunkBase += size;
+        flush(out);
+        return true;
+    };
+
+    bool ok = true;
+    if (loaded != nullptr) {
+        onChunk(loaded->data(), loaded->size());
+    } else {
+        int fd = openInput(path);
+        if (fd < 0) {
+            return false;
+        }
+        ok = options.decompress ? readDecompressedChunks(fd, onChunk) : readChunks(fd, onChunk);
+        closeInput(fd);
+    }
+    ac.finishScan(state, onMatch);
+
+    if (options.mode == GrepOptions::Mode::Count) {
+        out += name + ':' + to_string(matchingLines) + '\n';
+    } else if (options.mode == GrepOptions::Mode::FilesWithMatches && matched) {
+        out += name + '\n';
+    } else if (binary && matched) {
+        out += "Binary file " + name + " matches\n";
+    }
+    return ok;
+}
+
+/**
+ * @brief Writes per-input output buffers to a stream in input order, whatever
+ *        order the inputs finish in.
+ *
+ * Completed buffers wait until every earlier input is written. The input at
+ * the head of the order may also write while it is still being scanned, which
+ * keeps memory bounded for huge files with many matches. Scanners call
+ * admit() before starting an input, so at most `window` inputs past the head
+ * can be waiting at any time.
+ */
+class OrderedOutput {
+private:
+    FILE* stream;
+    size_t window;
+    mutex lock;
+    condition_variable headChanged;
+    size_t nextIndex = 0;           // The input whose output is written next
+    map<size_t, string> completed;  // Finished inputs waiting for earlier ones
+
+public:
+    OrderedOutput(FILE* stream, size_t window = numeric_limits<size_t>::max()) : stream(stream), window(window) {}
+
+    /**
+     * @brief Whether input `index` may start: it must lie fewer than `window`
+     *        inputs past the one being written.
+     *
+     * @param wait Block until it may, rather than return false. Scanners must
+     *             start inputs in an order where every input more than
+     *             `window` past the head is started after the head, or waiting
+     *             can deadlock.
+     */
+    bool admit(size_t index, bool wait) {
+        unique_lock<mutex> guard(lock);
+        auto admitted = [&]() { return index < nextIndex || index - nextIndex < window; };
+        if (wait) {
+            headChanged.wait(guard, admitted);
+        }
+        return admitted();
+    }
+
+    // Writes and clears `text` if input `index` is the one being written.
+    void writeIfHead(size_t index, string& text) {
+        lock_guard<mutex> guard(lock);
+        if (index == nextIndex && !text.empty()) {
+            fwrite(text.data(), 1, text.size(), stream);
+            text.clear();
+        }
+    }
+
+    // Hands over the remaining output of input `index`.
+    void complete(size_t index, string&& text) {
+        lock_guard<mutex> guard(lock);
+        completed.emplace(index, move(text));
+        size_t head = nextIndex;
+        for (auto it = completed.begin(); it != completed.end() && it->first == nextIndex;
+             it = completed.erase(it), ++nextIndex) {
+            fwrite(it->second.data(), 1, it->second.size(), stream);
+        }
+        if (nextIndex != head) {
+            headChanged.notify_all();
+        }
+    }
+};
+
+// Appends the entries of directory `dir` to `files` and its subdirectories to
+// `subdirectories`; false, with errno set, if `dir` cannot be opened.
+bool listDirectory(const string& dir, size_t rootIndex, vector<InputFile>& files, vector<string>& subdirectories) {
+    DIR* handle = opendir(dir.c_str());
+    if (handle == nullptr) {
+        return false;
+    }
+    string prefix = dir.back() == '/' ? dir : dir + '/';
+    while (dirent* entry = readdir(handle)) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        // d_type saves a stat() for directories; files need one for their size.
+        if (entry->d_type == DT_DIR) {
+            subdirectories.push_back(prefix + name);
+            continue;
+        }
+        if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN) {
+            continue; // Symbolic links, devices, sockets, fifos
+        }
+        struct stat info;
+        if (fstatat(dirfd(handle), name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            subdirectories.push_back(prefix + name);
+        } else if (S_ISREG(info.st_mode)) {
+            files.push_back({prefix + name, static_cast<size_t>(info.st_size), rootIndex});
+        }
+    }
+    closedir(handle);
+    return true;
+}
+
+/**
+ * @brief Lists the files named by `paths`, walking directories in parallel.
+ *
+ * Threads take directories from a shared stack, list them without holding
+ * the lock and push back the subdirectories they find; the walk ends when
+ * the stack is empty and no thread is still listing. Symbolic links met
+ * inside directories are not followed, so the walk cannot loop.
+ *
+ * @param unreadable Receives the directories that could not be opened, with
+ *                   the errno of the failure.
+ * @return Operands in command-line order; the files below a directory
+ *         operand sorted by path, so output order does not depend on timing.
+ */
+vector<InputFile> listInputFiles(const vector<string>& paths, unsigned numThreads,
+                                 vector<pair<string, int>>& unreadable) {
+    vector<InputFile> files;
+    vector<pair<string, size_t>> stack; // Directories to list, with their root index
+    for (size_t rootIndex = 0; rootIndex < paths.size(); ++rootIndex) {
+        const string& path = paths[rootIndex];
+        struct stat info;
+        if (path != "-" && stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            stack.emplace_back(path, rootIndex);
+        } else {
+            // Unreadable operands stay in the list so scanning reports them.
+            bool regular = path != "-" && stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+            files.push_back({path, regular ? static_cast<size_t>(info.st_size) : 0, rootIndex});
+        }
+    }
+
+    mutex lock;
+    condition_variable changed;
+    size_t listing = 0; // Threads currently listing a directory
+    vector<vector<InputFile>> found(max(1u, numThreads));
+    auto worker = [&](vector<InputFile>& local) {
+        vector<string> subdirectories;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [&]() { return !stack.empty() || listing == 0; });
+            if (stack.empty()) {
+                return;
+            }
+            pair<string, size_t> dir = move(stack.back());
+            stack.pop_back();
+            ++listing;
+            guard.unlock();
+
+            subdirectories.clear();
+            bool listed = listDirectory(dir.first, dir.second, local, subdirectories);
+            int error = errno;
+
+            guard.lock();
+            --listing;
+            if (!listed) {
+                unreadable.emplace_back(move(dir.first), error);
+            }
+            for (string& subdirectory : subdirectories) {
+                stack.emplace_back(move(subdirectory), dir.second);
+            }
+            if (!subdirectories.empty() || (listing == 0 && stack.empty())) {
+                changed.notify_all();
+            }
+        }
+    };
+    vector<thread> threads;
+    for (size_t t = 1; t < found.size(); ++t) {
+        threads.emplace_back(worker, ref(found[t]));
+    }
+    worker(found[0]);
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    for (vector<InputFile>& local : found) {
+        files.insert(files.end(), make_move_iterator(local.begin()), make_move_iterator(local.end()));
+    }
+    // Operands keep their order; directory contents join their operand's position.
+    stable_sort(files.begin(), files.end(), [](const InputFile& a, const InputFile& b) {
+        return a.rootIndex != b.rootIndex ? a.rootIndex < b.rootIndex : a.path < b.path;
+    });
+    sort(unreadable.begin(), unreadable.end());
+    return files;
+}
+
+// Output buffered beyond this size is written early by the input at the head of the order.
+const size_t kGrepFlushThreshold = 1 << 20;
+// Inputs may start at most this many places past the one whose output is being written.
+const size_t kGrepRunAhead = 1024;
+
+int runGrepCommand(int argc, char** argv) {
+    GrepOptions options;
+    if (!parseGrepArgs(argc, argv, options)) {
+        return 2;
+    }
+    unique_ptr<AhoCorasick> ac = buildGrepAutomaton(options);
+    vector<pair<string, int>> unreadable;
+    vector<InputFile> files = listInputFiles(options.paths, options.numThreads, unreadable);
+    for (const auto& [dir, error] : unreadable) {
+        cerr << argv[0] << ": " << dir << ": " << strerror(error) << endl;
+    }
+
+    // Largest files first, so a big file picked up last does not leave one
+    // thread scanning alone; output still follows the order of `files`. The
+    // sort stays within blocks of half the run-ahead, so every input is
+    // started after the inputs a whole run-ahead before it (see admit()).
+    vector<size_t> schedule(files.size());
+    iota(schedule.begin(), schedule.end(), 0);
+    for (size_t begin = 0; begin < schedule.size(); begin += kGrepRunAhead / 2) {
+        size_t end = min(schedule.size(), begin + kGrepRunAhead / 2);
+        stable_sort(schedule.begin() + begin, schedule.begin() + end, [&files](size_t a, size_t b) {
+            return files[a].size > files[b].size;
+        });
+    }
+
+    static char outputBuffer[1 << 16];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+    OrderedOutput output(stdout, kGrepRunAhead);
+    atomic<bool> anyMatched{false};
+    atomic<bool> anyError{!unreadable.empty()};
+
+    auto grepFile = [&](ScanState& state, size_t index, const string_view* loaded) {
+        const string& path = files[index].path;
+        string out;
+        bool matched = false;
+        auto flush = [&output, index](string& text) {
+            if (text.size() >= kGrepFlushThreshold) {
+                output.writeIfHead(index, text);
+            }
+        };
+        if (!grepInput(*ac, options, path, state, out, matched, flush, loaded)) {
+            cerr << (string(argv[0]) + ": " + path + ": cannot read\n");
+            anyError = true;
+        }
+        if (matched) {
+            anyMatched = true;
+        }
+        output.complete(index, move(out));
+    };
+
+    // Each worker keeps one scan state.
+    size_t threadCount = min<size_t>(options.numThreads, max<size_t>(1, files.size()));
+    vector<ScanState> states(threadCount);
+    if (options.ingest && !options.decompress) {
+        auto admit = [&output](size_t index, bool wait) { return output.admit(index, wait); };
+        ingestFiles(files, schedule, threadCount, IngestOptions(), admit,
+                    [&](unsigned worker, size_t index, const char* data, size_t size) {
+            string_view loaded(data, size);
+            grepFile(states[worker], index, data != nullptr ? &loaded : nullptr);
+        });
+    } else {
+        atomic<size_t> next{0};
+        auto worker = [&](unsigned id) {
+            for (size_t k = next++; k < schedule.size(); k = next++) {
+                output.admit(schedule[k], true);
+                grepFile(states[id], schedule[k], nullptr);
+            }
+        };
+        vector<thread> threads;
+        for (unsigned t = 1; t < threadCount; ++t) {
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+    fflush(stdout);
+
+    return anyError ? 2 : anyMatched ? 0 : 1;
+}
+
+/**
+ * @brief aho_corasick bench [MEGABYTES]: scan throughput of CompiledAutomaton
+ *        layouts across automaton sizes.
+ *
+ * Random patterns over a 16-letter alphabet are scanned in skewed random
+ * text (letter k has weight 1/(k+1), so some states are much hotter than
+ * others). Each column changes one thing against the default BFS layout on
+ * the heap, on its own automaton: the table on huge pages, frequency
+ * ordering from a 1 MiB sample, and the text split into 8 interleaved
+ * streams without and with prefetching.
+ */
+int runBenchCommand(int argc, char** argv) {
+    size_t megabytes = argc >= 3 ? max(1, atoi(argv[2])) : 64;
+    unsigned seed = 2024;
+    auto nextRandom = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) & 0xffffff;
+    };
+    // Skewed letters: cumulative weights of 1/(k+1) for k < 16.
+    double cumulative[16];
+    double total = 0;
+    for (int k = 0; k < 16; ++k) {
+        total += 1.0 / (k + 1);
+        cumulative[k] = total;
+    }
+    auto nextLetter = [&]() {
+        double x = nextRandom() / double(0x1000000) * total;
+        int k = 0;
+        while (k < 15 && cumulative[k] < x) {
+            ++k;
+        }
+        return static_cast<char>('a' + k);
+    };
+
+    string text(megabytes << 20, '\0');
+    for (char& ch : text) {
+        ch = nextLetter();
+    }
+    vector<string_view> streams;
+    size_t piece = text.size() / CompiledAutomaton<>::kInterleavedStreams;
+    for (size_t k = 0; k < CompiledAutomaton<>::kInterleavedStreams; ++k) {
+        streams.push_back(string_view(text).substr(k * piece, piece));
+    }
+
+    printf("%10s %10s %10s %12s %12s %12s %12s %12s\n", "patterns", "states", "table MB", "bfs MB/s",
+           "huge MB/s", "freq MB/s", "inter MB/s", "prefetch MB/s");
+    for (size_t patternCount : {1000, 30000, 300000, 1000000}) {
+        vector<vector<uint8_t>> patterns;
+        for (size_t p = 0; p < patternCount; ++p) {
+            vector<uint8_t> pattern;
+            for (int length = 6 + nextRandom() % 10; length > 0; --length) {
+                pattern.push_back(static_cast<uint8_t>(nextLetter()));
+            }
+            patterns.push_back(pattern);
+        }
+
+        size_t matches = 0;
+        auto onMatch = [&matches](const Match&) { ++matches; };
+        auto throughput = [&](auto&& run) {
+            auto start = chrono::steady_clock::now();
+            run();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            return text.size() / seconds / (1 << 20);
+        };
+
+        CompiledAutomaton<uint32_t, uint8_t> plain(patterns);
+        double bfsRate = throughput([&]() { plain.search(text, onMatch); });
+        double hugeRate = 0;
+        {
+            CompiledOptions hugePages;
+            hugePages.hugePages = true;
+            CompiledAutomaton<uint32_t, uint8_t> huge(patterns, hugePages);
+            hugeRate = throughput([&]() { huge.search(text, onMatch); });
+        }
+        double frequencyRate = 0;
+        {
+            CompiledAutomaton<uint32_t, uint8_t> frequency(patterns);
+            frequency.reorderByFrequency(string_view(text).substr(0, 1 << 20));
+            frequencyRate = throughput([&]() { frequency.search(text, onMatch); });
+        }
+        auto onStreamMatch = [&matches](size_t, const Match&) { ++matches; };
+        double interleavedRate = throughput([&]() { plain.searchInterleaved(streams, onStreamMatch, false); });
+        double prefetchRate = throughput([&]() { plain.searchInterleaved(streams, onStreamMatch, true); });
+
+        printf("%10zu %10zu %10.1f %12.0f %12.0f %12.0f %12.0f %12.0f\n", patternCount, plain.size(),
+               plain.tableBytes() / double(1 << 20), bfsRate, hugeRate, frequencyRate, interleavedRate,
+               prefetchRate);
+    }
+    return 0;
+}
+
+// The linear congruential generator of the randomized tests; each test seeds
+// its own so that its inputs stay the same whatever runs before it.
+class TestRandom {
+private:
+    unsigned seed;
+
+public:
+    explicit TestRandom(unsigned seed) : seed(seed) {}
+
+    // The next value, in [0, 0x8000).
+    unsigned operator()() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    }
+};
+
+// A match callback appending (pattern index, start, end) to `found`.
+inline auto collectMatches(vector<tuple<int, size_t, size_t>>& found) {
+    return [&found](const Match& match) {
+        found.emplace_back(match.patternIndex, match.startPosition, match.endPosition);
+    };
+}
+
+// A match callback appending (pattern index, start, end, payload) to `found`.
+inline auto collectMatches(vector<tuple<int, size_t, size_t, uint64_t>>& found) {
+    return [&found](const Match& match) {
+        found.emplace_back(match.patternIndex, match.startPosition, match.endPosition, match.payload);
+    };
+}
+
+void runTest(const string& testName,
+             const vector<string>& patterns,
+             const string& text,
+             vector<pair<int, int>> expected_matches,
+             const AhoCorasickOptions& options = AhoCorasickOptions()
+) {
+    cout << "Running test: " << testName << "..." << endl;
+    AhoCorasick ac(options);
+    for (const auto& p : patterns) {
+        ac.addPattern(p);
+    }
+    ac.buildFailureLinks();
+
+    vector<pair<int, int>> actual_matches = ac.search(text);
+
+    // The threaded build must produce the same automaton as the serial one.
+    AhoCorasick parallel_ac(options);
+    parallel_ac.addPatterns(patterns, 4);
+    parallel_ac.buildFailureLinks(4);
+    vector<pair<int, int>> parallel_matches = parallel_ac.search(text);
+
+    // So must the sorted bulk build.
+    AhoCorasick bulk_ac(patterns, false, options);
+    vector<pair<int, int>> bulk_matches = bulk_ac.search(text);
+
+    auto sort_key = [](const pair<int, int>& a, const pair<int, int>& b) {
+        if (a.second != b.second) {
+            return a.second < b.second;
+        }
+        return a.first < b.first;
+    };
+    sort(actual_matches.begin(), actual_matches.end(), sort_key);
+    sort(parallel_matches.begin(), parallel_matches.end(), sort_key);
+    sort(bulk_matches.begin(), bulk_matches.end(), sort_key);
+    sort(expected_matches.begin(), expected_matches.end(), sort_key);
+
+    assert(actual_matches == expected_matches);
+    assert(parallel_matches == expected_matches);
+    assert(bulk_matches == expected_matches);
+
+    cout << "Test '" << testName << "' PASSED." << endl << endl;
+}
+
+void testAhoCorasick() {
+    cout << "--- Starting AhoCorasick Tests ---" << endl;
+
+    // Test Case 1: Simple Non-Overlapping
+    runTest("Simple Non-Overlapping",
+            {"a", "b", "c"},
+            "abc",
+            {{0, 0}, {1, 1}, {2, 2}}
+    );
+
+    // Test Case 2: Standard Overlap Example
+    runTest("Standard Overlap",
+            {"he", "she", "his", "hers"},
+            "ushers",
+            {{0, 3}, {1, 3}, {3, 5}}
+    );
+
+    // Test Case 3: Prefix/Suffix/Overlap Mix
+    runTest("Prefix/Suffix/Overlap Mix",
+            {"a", "ab", "bab", "bc", "bca", "c", "caa"},
+            "abccab",
+            {{0, 0}, {1, 1}, {3, 2}, {5, 2}, {5, 3}, {0, 4}, {1, 5}}
+    );
+
+    // Test Case 4: Multiple Occurrences of Same Pattern
+     runTest("Multiple Occurrences",
+            {"aba"},
+            "ababaxaba",
+            {{0, 2}, {0, 4}, {0, 8}}
+    );
+
+     // Test Case 5: No Matches
+    runTest("No Matches",
+            {"xyz", "123"},
+            "abcde",
+            {}
+    );
+
+     // Test Case 6: Empty Text
+    runTest("Empty Text",
+            {"a", "b"},
+            "",
+            {}
+    );
+
+    // Test Case 7: Empty Patterns
+    runTest("Empty Patterns",
+            {},
+            "abc",
+            {}
+    );
+
+    // Test Case 8: Longer Text and More Overlaps (mississippi example)
+    runTest("Complex Overlaps (Mississippi)",
+            {"i", "is", "ppi", "sip", "mississippi"},
+            "mississippi",
+            {
+                {0, 1},
+                {1, 2},
+                {0, 4},
+                {1, 5},
+                {0, 7},
+                {3, 8},
+                {0, 10},
+                {2, 10},
+                {4, 10}
+            }
+    );
+
+    // Test Case 9: Patterns ending at the same place
+    runTest("Patterns Ending Together",
+            {"a", "ba", "cba"},
+            "dcba",
+            { {0, 3}, {1, 3}, {2, 3} }
+    );
+
+    AhoCorasickOptions caseInsensitive;
+    caseInsensitive.caseFolding = CaseFolding::Ascii;
+
+    // Test Case 10: ASCII case folding applies to both patterns and text
+    runTest("ASCII Case Insensitive",
+            {"He", "SHE", "his", "hErS"},
+            "UsHeRs",
+            {{0, 3}, {1, 3}, {3, 5}},
+            caseInsensitive
+    );
+
+    // Test Case 11: Without folding, case differences do not match
+    runTest("Case Sensitive By Default",
+            {"He", "SHE", "his", "hErS"},
+            "UsHeRs",
+            {{0, 3}}
+    );
+
+    // Test Case 12: Folding leaves non-letters and high bytes untouched
+    runTest("ASCII Folding Only Touches Letters",
+            {"a@1", "\xC9t\xC9"},
+            "A@1 \xC9T\xC9 \xE9t\xE9",
+            {{0, 2}, {1, 6}},
+            caseInsensitive
+    );
+
+    AhoCorasickOptions unicode;
+    unicode.caseFolding = CaseFolding::Unicode;
+
+    // Test Case 13: Full case folding maps sharp s to "ss" in patterns and text
+    runTest("Unicode Sharp S",
+            {"STRASSE", "stra\u00dfe"},
+            "Die Stra\u00dfe, die STRASSE",
+            {{0, 10}, {1, 10}, {0, 23}, {1, 23}},
+            unicode
+    );
+
+    // Test Case 14: Greek final sigma and Cyrillic capitals fold to lowercase
+    runTest("Unicode Greek And Cyrillic",
+            {"\u039f\u0394\u039f\u03a3", "\u043c\u0438\u0440"},
+            "\u03bf\u03b4\u03bf\u03c2 \u041c\u0418\u0420",
+            {{0, 7}, {1, 14}},
+            unicode
+    );
+
+    // Test Case 15: Compatibility mode folds fullwidth forms and ligatures
+    AhoCorasickOptions unicodeCompat;
+    unicodeCompat.caseFolding = CaseFolding::UnicodeCompat;
+    runTest("Unicode Compatibility Forms",
+            {"office", "A1"},
+            "\uff2f\ufb03ce \uff41\u00b9",
+            {{0, 7}, {1, 13}},
+            unicodeCompat
+    );
+
+    // Test Case 16: The fold table covers Latin Extended-B, Greek and Latin Extended Additional
+    runTest("Unicode Full Folding Table",
+            {"\u01c4", "\u0390", "\u1e9b"},
+            "\u01c5 \u03b9\u0308\u0301 \u1e60",
+            {{0, 1}, {1, 8}, {2, 12}},
+            unicode
+    );
+
+    // Test Case 17: A match completed twice inside one folded code point is reported once
+    runTest("Unicode Expansion Reports Once",
+            {"s", "ss"},
+            "\u00df",
+            {{0, 1}, {1, 1}},
+            unicode
+    );
+
+    // Test Case 18: Compatibility mode matches precomposed and decomposed forms
+    runTest("Unicode Canonical Equivalence",
+            {"caf\u00e9", "CAFE\u0301"},
+            "cafe\u0301 CAF\u00c9",
+            {{0, 5}, {1, 5}, {0, 11}, {1, 11}},
+            unicodeCompat
+    );
+
+
+    cout << "--- All AhoCorasick Tests Passed! ---" << endl;
+}
+
+unique_ptr<const AhoCorasick> makeSnapshot(const vector<string>& patterns) {
+    unique_ptr<AhoCorasick> ac(new AhoCorasick());
+    for (const auto& p : patterns) {
+        ac->addPattern(p);
+    }
+    ac->buildFailureLinks();
+    return unique_ptr<const AhoCorasick>(ac.release());
+}
+
+void testAutomatonHolder() {
+    cout << "--- Starting AutomatonHolder Tests ---" << endl;
+
+    AutomatonHolder holder(makeSnapshot({"he", "she"}), 4);
+    int reader = holder.registerReader();
+    assert(reader >= 0);
+
+    {
+        SnapshotGuard pinned(holder, reader);
+        assert(pinned->search("she").size() == 2);
+
+        // The pinned snapshot must survive a publish until the reader lets go.
+        holder.publish(makeSnapshot({"his"}));
+        assert(holder.retiredCount() == 1);
+        assert(pinned->search("she").size() == 2);
+    }
+    holder.reclaim();
+    assert(holder.retiredCount() == 0);
+
+    {
+        SnapshotGuard pinned(holder, reader);
+        vector<pair<int, int>> matches = pinned->search("this");
+        assert(matches.size() == 1 && matches[0] == make_pair(0, 3));
+    }
+
+    // Readers keep scanning while the control thread swaps snapshots under them.
+    holder.publish(makeSnapshot({"hers"}));
+    vector<thread> scanners;
+    atomic<bool> stop{false};
+    for (int t = 0; t < 3; ++t) {
+        scanners.emplace_back([&holder, &stop]() {
+            int slot = holder.registerReader();
+            assert(slot >= 0);
+            while (!stop.load()) {
+                SnapshotGuard pinned(holder, slot);
+                assert(pinned->search("ushers").size() >= 1);
+            }
+            holder.unregisterReader(slot);
+        });
+    }
+    for (int round = 0; round < 100; ++round) {
+        holder.publish(makeSnapshot(round % 2 ? vector<string>{"he", "she"} : vector<string>{"hers"}));
+    }
+    stop.store(true);
+    for (thread& t : scanners) {
+        t.join();
+    }
+    holder.reclaim();
+    assert(holder.retiredCount() == 0);
+    holder.unregisterReader(reader);
+
+    cout << "--- All AutomatonHolder Tests Passed! ---" << endl;
+}
+
+void testParallelBuild() {
+    cout << "--- Starting Parallel Build Tests ---" << endl;
+
+    // Enough patterns that every BFS level is split across worker threads.
+    vector<string> patterns;
+    TestRandom nextRandom(12345);
+    for (int i = 0; i < 5000; ++i) {
+        string p;
+        int length = 1 + nextRandom() % 8;
+        for (int j = 0; j < length; ++j) {
+            p += static_cast<char>('a' + nextRandom() % 4);
+        }
+        patterns.push_back(p);
+    }
+    string text;
+    for (int i = 0; i < 20000; ++i) {
+        text += static_cast<char>('a' + nextRandom() % 4);
+    }
+
+    AhoCorasick serial;
+    for (const auto& p : patterns) {
+        serial.addPattern(p);
+    }
+    serial.buildFailureLinks();
+
+    AhoCorasick parallel;
+    parallel.addPatterns(patterns, 4);
+    parallel.buildFailureLinks(4);
+
+    vector<string> sortedPatterns = patterns;
+    sort(sortedPatterns.begin(), sortedPatterns.end());
+    AhoCorasick presorted(sortedPatterns, true);
+    assert(parallel.memoryUsage().total() == serial.memoryUsage().total());
+    assert(presorted.memoryUsage().total() == serial.memoryUsage().total());
+
+    vector<pair<int, int>> expected = serial.search(text);
+    vector<pair<int, int>> actual = parallel.search(text);
+    sort(expected.begin(), expected.end());
+    sort(actual.begin(), actual.end());
+    assert(!expected.empty());
+    assert(actual == expected);
+
+    // Same matches, modulo the renumbering the caller did by sorting.
+    vector<pair<string, int>> expectedByString, presortedByString;
+    for (const auto& m : expected) {
+        expectedByString.push_back({string(serial.getPattern(m.first)), m.second});
+    }
+    for (const auto& m : presorted.search(text)) {
+        presortedByString.push_back({string(presorted.getPattern(m.first)), m.second});
+    }
+    sort(expectedByString.begin(), expectedByString.end());
+    sort(presortedByString.begin(), presortedByString.end());
+    assert(presortedByString == expectedByString);
+
+    // A skewed dictionary shares its first bytes, so its bucket is split on
+    // longer prefixes; patterns ending on a split prefix, and nodes already
+    // in the trie, are accounted for like in a serial build.
+    vector<string> urls = {"http", "http://"};
+    for (int i = 0; i < 3000; ++i) {
+        string url = "http://";
+        int length = 1 + nextRandom() % 6;
+        for (int j = 0; j < length; ++j) {
+            url += static_cast<char>('a' + nextRandom() % 4);
+        }
+        urls.push_back(url);
+    }
+    AhoCorasick serialUrls;
+    serialUrls.addPattern("http://ab");
+    for (const string& url : urls) {
+        serialUrls.addPattern(url);
+    }
+    serialUrls.buildFailureLinks();
+    AhoCorasickOptions budget;
+    budget.memoryBudget = serialUrls.memoryUsage().total();
+    AhoCorasick parallelUrls(budget);
+    parallelUrls.addPattern("http://ab");
+    bool urlsAdded = parallelUrls.addPatterns(urls, 4);
+    assert(urlsAdded);
+    parallelUrls.buildFailureLinks(4);
+    assert(parallelUrls.memoryUsage().total() == serialUrls.memoryUsage().total());
+    string urlText = "see http://" + text.substr(0, 2000) + " and http://" + text.substr(2000, 2000);
+    expected = serialUrls.search(urlText);
+    actual = parallelUrls.search(urlText);
+    sort(expected.begin(), expected.end());
+    sort(actual.begin(), actual.end());
+    assert(!expected.empty());
+    assert(actual == expected);
+
+    budget.memoryBudget -= 1;
+    AhoCorasick tightUrls(budget);
+    tightUrls.addPattern("http://ab");
+    urlsAdded = tightUrls.addPatterns(urls, 4);
+    assert(!urlsAdded);
+    assert(tightUrls.budgetExceeded());
+
+    cout << "--- All Parallel Build Tests Passed! ---" << endl;
+}
+
+void testAnchoredMatching() {
+    cout << "--- Starting Anchored Matching Tests ---" << endl;
+
+    AhoCorasick ac;
+    ac.addPattern("cat", AnchorWord);
+    ac.addPattern("dog");
+    ac.addPattern("log", AnchorLineStart);
+    ac.addPattern("end", AnchorInputEnd);
+    ac.addPattern("go", AnchorWordEnd);
+    ac.buildFailureLinks();
+
+    vector<pair<int, int>> matches = ac.search("cat concat cats_ dog\nlog blog catalog go\ndogend end");
+    sort(matches.begin(), matches.end(), [](const pair<int, int>& a, const pair<int, int>& b) {
+        return a.second < b.second;
+    });
+    vector<pair<int, int>> expected = {
+        {0, 2},  // "cat" as a whole word; "concat" and "cats_" are rejected
+        {1, 19}, // "dog" is unanchored
+        {2, 23}, // "log" at the start of a line, but not inside "blog" or "catalog"
+        {4, 39}, // "go" followed by a line break counts as a word end
+        {1, 43},
+        {3, 50}, // Only the final "end" reaches the end of the input
+    };
+    assert(matches == expected);
+
+    // Anchors are evaluated against the original text in the Unicode modes too.
+    AhoCorasickOptions unicode;
+    unicode.caseFolding = CaseFolding::Unicode;
+    AhoCorasick folded(unicode);
+    folded.addPattern("strasse", AnchorWord | AnchorInputStart);
+    folded.buildFailureLinks();
+    assert(folded.search("Straße und STRASSE").size() == 1);
+    assert(folded.search("Hauptstraße").empty());
+
+    cout << "--- All Anchored Matching Tests Passed! ---" << endl;
+}
+
+void testPayloads() {
+    cout << "--- Starting Payload Tests ---" << endl;
+
+    // A payload packing rule id (high 32 bits), severity and category.
+    auto pack = [](uint32_t ruleId, uint16_t severity, uint16_t category) {
+        return (static_cast<uint64_t>(ruleId) << 32) | (static_cast<uint64_t>(severity) << 16) | category;
+    };
+
+    AhoCorasick ac;
+    ac.addPattern("he", AnchorNone, pack(1001, 2, 7));
+    ac.addPattern("she", AnchorNone, pack(1002, 5, 7));
+    ac.addPattern("hers");
+    ac.buildFailureLinks();
+
+    vector<pair<int, uint64_t>> seen;
+    ac.search("ushers", [&seen](const Match& match) {
+        seen.push_back({match.endPosition, match.payload});
+    });
+    sort(seen.begin(), seen.end());
+    vector<pair<int, uint64_t>> expected = {{3, pack(1001, 2, 7)}, {3, pack(1002, 5, 7)}, {5, 0}};
+    sort(expected.begin(), expected.end());
+    assert(seen == expected);
+
+    assert(ac.getPayload(1) == pack(1002, 5, 7));
+    assert(ac.getPayload(3) == 0);
+
+    cout << "--- All Payload Tests Passed! ---" << endl;
+}
+
+void testDeduplication() {
+    cout << "--- Starting Deduplication Tests ---" << endl;
+
+    AhoCorasickOptions options;
+    options.caseFolding = CaseFolding::Ascii;
+    options.deduplicate = true;
+    options.keepDuplicateIds = true;
+
+    AhoCorasick ac(options);
+    vector<int> indices;
+    indices.push_back(ac.addPattern("he", AnchorNone, 11));
+    indices.push_back(ac.addPattern("she"));
+    indices.push_back(ac.addPattern("HE", AnchorNone, 99)); // Same key after folding
+    indices.push_back(ac.addPattern("he", AnchorWord));     // Different anchors stay distinct
+    indices.push_back(ac.addPattern("she"));
+    assert(indices == vector<int>({0, 1, 0, 2, 1}));
+    ac.buildFailureLinks();
+
+    vector<pair<int, int>> matches = ac.search("she he");
+    sort(matches.begin(), matches.end());
+    vector<pair<int, int>> expected = {{0, 2}, {0, 5}, {1, 2}, {2, 5}};
+    assert(matches == expected);
+    assert(ac.getPayload(0) == 11);
+    assert((ac.getDuplicateIds(0) == vector<int>{0, 2}));
+    assert((ac.getDuplicateIds(1) == vector<int>{1, 4}));
+    assert((ac.getDuplicateIds(2) == vector<int>{3}));
+
+    // The sorted bulk build collapses duplicates; indices stay input positions.
+    AhoCorasick bulk({"b", "a", "B", "c", "a"}, false, options);
+    assert(bulk.getPattern(0) == "b" && bulk.getPattern(1) == "a" && bulk.getPattern(3) == "c");
+    assert(bulk.getPattern(2) == "B" && bulk.getPattern(5).empty());
+    assert((bulk.getDuplicateIds(0) == vector<int>{0, 2}));
+    assert((bulk.getDuplicateIds(1) == vector<int>{1, 4}));
+    assert((bulk.getDuplicateIds(3) == vector<int>{3}));
+    assert(bulk.getDuplicateIds(2).empty());
+    matches = bulk.search("abc");
+    sort(matches.begin(), matches.end());
+    expected = {{0, 1}, {1, 0}, {3, 2}};
+    assert(matches == expected);
+
+    cout << "--- All Deduplication Tests Passed! ---" << endl;
+}
+
+void testMemoryAccounting() {
+    cout << "--- Starting Memory Accounting Tests ---" << endl;
+
+    vector<string> patterns = {"he", "she", "his", "hers", "a-pattern-longer-than-sso"};
+
+    AhoCorasick serial;
+    for (const auto& p : patterns) {
+        serial.addPattern(p);
+    }
+    MemoryUsage usage = serial.memoryUsage();
+    // Root, h, he, her, hers, hi, his, s, sh, she, plus 25 nodes for the long pattern.
+    assert(usage.states == 35 * sizeof(TrieNode));
+    // The 37 pattern bytes and six offsets, counted at whatever capacity the
+    // arena and offset vector have grown to (at most twice what they hold).
+    size_t storedBytes = 2 + 3 + 3 + 4 + 25 + 6 * sizeof(size_t);
+    assert(usage.patternStorage >= storedBytes && usage.patternStorage <= 2 * storedBytes);
+    assert(usage.total() == usage.states + usage.edges + usage.outputs + usage.patternStorage + usage.allocatorOverhead);
+
+    // Every build path keeps the same books.
+    AhoCorasick bulk(patterns);
+    AhoCorasick parallel;
+    parallel.addPatterns(patterns, 4);
+    for (const AhoCorasick* built : {&bulk, &parallel}) {
+        MemoryUsage builtUsage = built->memoryUsage();
+        assert(builtUsage.states == usage.states && builtUsage.patternStorage == usage.patternStorage);
+        assert(builtUsage.total() == usage.total());
+    }
+
+    // Adds beyond the budget are rejected without touching the automaton.
+    AhoCorasick sized;
+    sized.addPattern("he");
+    sized.addPattern("she");
+    AhoCorasickOptions options;
+    options.memoryBudget = sized.memoryUsage().total();
+
+    AhoCorasick bounded(options);
+    int he = bounded.addPattern("he");
+    int she = bounded.addPattern("she");
+    assert(he == 0 && she == 1);
+    assert(!bounded.budgetExceeded());
+    int hers = bounded.addPattern("hers");
+    assert(hers == -1);
+    assert(bounded.budgetExceeded());
+    assert(bounded.memoryUsage().total() == options.memoryBudget);
+    bool added = bounded.addPatterns({"his"}, 2);
+    assert(!added);
+    bounded.buildFailureLinks();
+    assert(bounded.search("ushers").size() == 2);
+    assert(bounded.getPattern(2).empty());
+
+    AhoCorasick tooBig(patterns, false, options);
+    assert(tooBig.budgetExceeded());
+    assert(tooBig.search("ushers").empty());
+
+    // Kept caller ids of duplicates count against the budget too.
+    AhoCorasickOptions keepIds;
+    keepIds.deduplicate = true;
+    keepIds.keepDuplicateIds = true;
+    AhoCorasick ids(keepIds);
+    ids.addPattern("he");
+    keepIds.memoryBudget = ids.memoryUsage().total();
+    AhoCorasick capped(keepIds);
+    int first = capped.addPattern("he");
+    int repeat = capped.addPattern("he");
+    assert(first == 0 && repeat == -1);
+    assert(capped.budgetExceeded());
+    assert(capped.getDuplicateIds(0) == vector<int>{0});
+
+    // Input wrongly claimed to be sorted is merged and measured like sorted input.
+    AhoCorasickOptions dedup;
+    dedup.deduplicate = true;
+    AhoCorasick claimed({"she", "he", "she"}, true, dedup);
+    AhoCorasick sorted({"she", "he", "she"}, false, dedup);
+    assert(claimed.memoryUsage().total() == sorted.memoryUsage().total());
+    assert(claimed.search("she").size() == 2);
+
+    cout << "--- All Memory Accounting Tests Passed! ---" << endl;
+}
+
+void testPatternStorage() {
+    cout << "--- Starting Pattern Storage Tests ---" << endl;
+
+    vector<string> patterns = {"he", "she", "his", "hers"};
+    vector<pair<int, int>> expected = {{0, 3}, {1, 3}, {3, 5}};
+
+    AhoCorasick arena(patterns);
+    assert(arena.getPattern(3) == "hers");
+    MemoryUsage arenaUsage = arena.memoryUsage();
+
+    // Only the lengths are kept, whichever way the patterns are added.
+    AhoCorasickOptions lengthsOnly;
+    lengthsOnly.patternStorage = PatternStorage::LengthsOnly;
+    AhoCorasick bulk(patterns, false, lengthsOnly);
+    AhoCorasick single(lengthsOnly);
+    for (const auto& p : patterns) {
+        single.addPattern(p, AnchorWordEnd);
+    }
+    single.buildFailureLinks();
+    AhoCorasick parallel(lengthsOnly);
+    parallel.addPatterns({"he", "she"}, 2);
+    parallel.addPatterns({"his", "hers"}, 2);
+    parallel.buildFailureLinks();
+
+    for (const AhoCorasick* ac : {&bulk, &parallel}) {
+        vector<pair<int, int>> matches = ac->search("ushers");
+        sort(matches.begin(), matches.end());
+        assert(matches == expected);
+        assert(ac->getPattern(0).empty());
+        assert(ac->memoryUsage().patternStorage == 0);
+        assert(ac->memoryUsage().total() < arenaUsage.total());
+    }
+    // Anchors still see the right start and end without the strings.
+    assert(single.search("ushers").size() == 1);
+
+    // Strings can also be dropped once the automaton is built.
+    arena.releasePatterns();
+    assert(arena.getPattern(3).empty());
+    assert(arena.memoryUsage().total() == bulk.memoryUsage().total());
+    assert(arena.search("ushers").size() == 3);
+
+    cout << "--- All Pattern Storage Tests Passed! ---" << endl;
+}
+
+void testMatchSpans() {
+    cout << "--- Starting Match Span Tests ---" << endl;
+
+    AhoCorasickOptions lengthsOnly;
+    lengthsOnly.patternStorage = PatternStorage::LengthsOnly;
+    AhoCorasick ac({"he", "she", "hers"}, false, lengthsOnly);
+    vector<Match> matches = ac.searchMatches("ushers");
+    assert(matches.size() == 3);
+    for (const Match& match : matches) {
+        int length = match.endPosition - match.startPosition + 1;
+        assert(length == (match.patternIndex == 0 ? 2 : match.patternIndex == 1 ? 3 : 4));
+    }
+
+    // Spans refer to the original text even when folding changes byte lengths.
+    AhoCorasickOptions unicode;
+    unicode.caseFolding = CaseFolding::Unicode;
+    AhoCorasick folded({"strasse", "ss"}, false, unicode);
+    matches = folded.searchMatches("Groß STRAßE");
+    vector<pair<int, int>> spans;
+    for (const Match& match : matches) {
+        spans.push_back({match.startPosition, match.endPosition});
+    }
+    // "ß" spans bytes 3-4 and 10-11; "STRAßE" spans bytes 6-12.
+    vector<pair<int, int>> expected = {{3, 4}, {10, 11}, {6, 12}};
+    assert(spans == expected);
+
+    cout << "--- All Match Span Tests Passed! ---" << endl;
+}
+
+void testChunkedScan() {
+    cout << "--- Starting Chunked Scan Tests ---" << endl;
+
+    // Splitting the text anywhere must not change the matches, including
+    // anchored matches whose context and UTF-8 sequences straddle a boundary.
+    auto collect = [](const AhoCorasick& ac, const string& text, const vector<size_t>& cuts) {
+        vector<tuple<int, size_t, size_t>> found;
+        auto onMatch = collectMatches(found);
+        ScanState state;
+        size_t previous = 0;
+        for (size_t cut : cuts) {
+            ac.scanChunk(state, text.data() + previous, cut - previous, onMatch);
+            previous = cut;
+        }
+        ac.scanChunk(state, text.data() + previous, text.size() - previous, onMatch);
+        ac.finishScan(state, onMatch);
+        sort(found.begin(), found.end());
+        return found;
+    };
+
+    for (CaseFolding mode : {CaseFolding::None, CaseFolding::Ascii, CaseFolding::Unicode}) {
+        AhoCorasickOptions options;
+        options.caseFolding = mode;
+        AhoCorasick ac(options);
+        ac.addPattern("he");
+        ac.addPattern("hers", AnchorWordEnd);
+        ac.addPattern("she", AnchorWord);
+        ac.addPattern("straße");
+        ac.addPattern("end", AnchorInputEnd | AnchorLineStart);
+        ac.buildFailureLinks();
+
+        string text = "ushers she Straße hers\nend";
+        vector<tuple<int, size_t, size_t>> whole = collect(ac, text, {});
+        assert(!whole.empty());
+        for (size_t cut = 0; cut <= text.size(); ++cut) {
+            assert(collect(ac, text, {cut}) == whole);
+        }
+        vector<size_t> everyByte;
+        for (size_t cut = 1; cut < text.size(); ++cut) {
+            everyByte.push_back(cut);
+        }
+        assert(collect(ac, text, everyByte) == whole);
+    }
+
+    // Only prefixes the decoder could complete are carried to the next chunk.
+    for (const char* prefix : {"\xC3", "\xE0\xA4", "\xED\x9F", "\xF0\x9F\x98", "\xF4\x8F"}) {
+        assert(isTruncatedUtf8(prefix, strlen(prefix)));
+    }
+    for (const char* prefix : {"\xC0", "\xE0\x80", "\xED\xA0", "\xF0\x80", "\xF4\x90", "\xF5\x80", "\xF7"}) {
+        assert(!isTruncatedUtf8(prefix, strlen(prefix)));
+    }
+
+    // Files are mapped; pipes go through the buffered fallback.
+    AhoCorasick ac({"needle", "hay"});
+    string text;
+    for (int i = 0; i < 50000; ++i) {
+        text += i % 1000 == 0 ? "needle " : "hay ";
+    }
+    size_t expected = 0;
+    ac.search(text, [&expected](const Match&) { ++expected; });
+
+    char path[] = "/tmp/aho_corasick_testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    ssize_t stored = write(fd, text.data(), text.size());
+    assert(stored == static_cast<ssize_t>(text.size()));
+    close(fd);
+    size_t count = 0;
+    bool scanned = scanFile(ac, path, [&count](const Match&) { ++count; });
+    assert(scanned && count == expected);
+
+    // A descriptor that was already partly read is scanned from its offset on.
+    size_t half = text.size() / 2;
+    size_t expectedRest = 0;
+    ac.search(text.substr(half), [&expectedRest](const Match&) { ++expectedRest; });
+    fd = open(path, O_RDONLY);
+    off_t position = lseek(fd, static_cast<off_t>(half), SEEK_SET);
+    assert(position == static_cast<off_t>(half));
+    count = 0;
+    scanned = scanFd(ac, fd, [&count](const Match&) { ++count; });
+    assert(scanned && count == expectedRest);
+    close(fd);
+
+    // A mapped file truncated while it is read delivers what is left, then fails.
+    fd = open(path, O_RDWR | O_TRUNC);
+    int resized = ftruncate(fd, 3 * kMappedWindowSize);
+    assert(resized == 0);
+    vector<size_t> delivered;
+    bool complete = readChunks(fd, [&](const char*, size_t size) {
+        if (delivered.empty()) {
+            int shrunk = ftruncate(fd, kMappedWindowSize + 100);
+            assert(shrunk == 0);
+        }
+        delivered.push_back(size);
+        return true;
+    });
+    close(fd);
+    assert(!complete && delivered == vector<size_t>({kMappedWindowSize, 100}));
+    unlink(path);
+    scanned = scanFile(ac, path, [](const Match&) {});
+    assert(!scanned);
+
+    int pipeFds[2];
+    int piped = pipe(pipeFds);
+    assert(piped == 0);
+    thread writer([&text, &pipeFds]() {
+        size_t written = 0;
+        while (written < text.size()) {
+            ssize_t n = write(pipeFds[1], text.data() + written, min<size_t>(text.size() - written, 4096));
+            assert(n > 0);
+            written += n;
+        }
+        close(pipeFds[1]);
+    });
+    count = 0;
+    scanned = scanFd(ac, pipeFds[0], [&count](const Match&) { ++count; });
+    writer.join();
+    close(pipeFds[0]);
+    assert(scanned && count == expected);
+
+    cout << "--- All Chunked Scan Tests Passed! ---" << endl;
+}
+
+void testGrep() {
+    cout << "--- Starting Grep Tests ---" << endl;
 
-    // Points to the nearest pattern-ending node in the failure path
-    TrieNode* outputLink;
+    // Late (anchored) matches reported after a chunk boundary keep their line.
+    LineCounter lines;
+    assert(lines.lineAt(2, "a\nb\n", 0) == 2);
+    lines.advance("a\nb\n", 4, 0);
+    assert(lines.lineAt(3, "c\nd", 4) == 3);
+    assert(lines.lineAt(6, "c\nd", 4) == 4);
 
-    // Stores indices of patterns ending EXACTLY at this node
-    vector<int> patternIndices;
+    char path[] = "/tmp/aho_corasick_grepXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    string text = "ushers\nHe said\nthe hers\n";
+    ssize_t stored = write(fd, text.data(), text.size());
+    assert(stored == static_cast<ssize_t>(text.size()));
+    close(fd);
 
-    // Constructor
-    TrieNode() : failureLink(nullptr), outputLink(nullptr) {}
-};
+    auto grep = [&path](GrepOptions options) {
+        options.patterns = {"he", "hers", "he"};
+        unique_ptr<AhoCorasick> ac = buildGrepAutomaton(options);
+        string out;
+        bool matched = false;
+        ScanState state;
+        bool read = grepInput(*ac, options, path, state, out, matched, [](string&) {});
+        assert(read);
+        return out;
+    };
+    string name = path;
+    GrepOptions options;
+    assert(grep(options) == name + ":1:2:he\n" + name + ":1:2:hers\n" + name + ":3:16:he\n" +
+                            name + ":3:19:he\n" + name + ":3:19:hers\n");
+    options.mode = GrepOptions::Mode::Count;
+    assert(grep(options) == name + ":2\n");
+    options.ignoreCase = true;
+    options.wordMatch = true;
+    assert(grep(options) == name + ":2\n"); // "He" on line 2, "hers" on line 3
+    options.mode = GrepOptions::Mode::FilesWithMatches;
+    assert(grep(options) == name + "\n");
 
-class AhoCorasick {
-private:
-    TrieNode* root;
-    vector<string> patterns; // Store the original patterns for reference
+    // Read-ahead does not decompress, so -U and -z exclude each other.
+    string args[] = {"aho_corasick", "grep", "-z", "he", "-U"};
+    char* argv[] = {&args[0][0], &args[1][0], &args[2][0], &args[3][0], &args[4][0]};
+    GrepOptions parsed;
+    bool accepted = parseGrepArgs(4, argv, parsed);
+    assert(accepted && parsed.decompress && parsed.patterns == vector<string>{"he"});
+    parsed = GrepOptions();
+    accepted = parseGrepArgs(5, argv, parsed);
+    assert(!accepted);
+    // Patterns with newlines are split into one pattern per line, as grep does.
+    args[2] = "-ehe\n\nshe";
+    argv[2] = &args[2][0];
+    parsed = GrepOptions();
+    accepted = parseGrepArgs(3, argv, parsed);
+    assert(accepted && parsed.patterns == vector<string>({"he", "she"}));
 
-    // Helper function to recursively delete the trie nodes
-    void deleteTrie(TrieNode* node) {
-        if (!node) return;
-        for (auto const& [key, val] : node->children) {
-            deleteTrie(val);
-        }
-        delete node;
+    // Matching binary files are only named unless asked for; -c and -l are unaffected.
+    fd = open(path, O_WRONLY | O_APPEND);
+    stored = write(fd, "he\0", 3);
+    assert(stored == 3);
+    close(fd);
+    assert(grep(options) == name + "\n");
+    options.mode = GrepOptions::Mode::Count;
+    assert(grep(options) == name + ":3\n");
+    options.mode = GrepOptions::Mode::Matches;
+    assert(grep(options) == "Binary file " + name + " matches\n");
+    options.scanBinary = true;
+    assert(grep(options) == name + ":2:7:he\n" + name + ":3:19:hers\n" + name + ":4:24:he\n");
+    // Files without matches print nothing, except a zero count with -c.
+    fd = open(path, O_WRONLY | O_TRUNC);
+    stored = write(fd, "x\0y", 3);
+    assert(stored == 3);
+    close(fd);
+    options.scanBinary = false;
+    assert(grep(options).empty());
+    options.mode = GrepOptions::Mode::Count;
+    assert(grep(options) == name + ":0\n");
+    unlink(path);
+
+    // Directory operands expand to their files sorted by path; other operands keep their place.
+    char root[] = "/tmp/aho_corasick_walkXXXXXX";
+    char* made = mkdtemp(root);
+    assert(made != nullptr);
+    string dir = root;
+    for (const char* subdirectory : {"/b", "/a", "/a/deep"}) {
+        int status = mkdir((dir + subdirectory).c_str(), 0700);
+        assert(status == 0);
+    }
+    vector<string> created = {dir + "/a/deep/x", dir + "/a/y", dir + "/b/z", dir + "/c"};
+    for (const string& file : created) {
+        FILE* handle = fopen(file.c_str(), "w");
+        fputs(file.c_str(), handle);
+        fclose(handle);
+    }
+    int linked = symlink((dir + "/a").c_str(), (dir + "/b/link").c_str());
+    assert(linked == 0);
+    vector<pair<string, int>> unreadable;
+    vector<InputFile> listed = listInputFiles({"-", dir, "missing"}, 4, unreadable);
+    vector<string> listedPaths;
+    for (const InputFile& file : listed) {
+        listedPaths.push_back(file.path);
     }
+    vector<string> expectedPaths = {"-"};
+    expectedPaths.insert(expectedPaths.end(), created.begin(), created.end());
+    expectedPaths.push_back("missing");
+    assert(listedPaths == expectedPaths);
+    assert(listed[1].size == created[0].size());
+    assert(unreadable.empty());
+    // A directory that cannot be opened is reported, not skipped silently.
+    vector<string> subdirectories;
+    bool opened = listDirectory(dir + "/gone", 0, listed, subdirectories);
+    assert(!opened && errno == ENOENT);
+    unlink((dir + "/b/link").c_str());
+    for (const string& file : created) {
+        unlink(file.c_str());
+    }
+    rmdir((dir + "/a/deep").c_str());
+    rmdir((dir + "/a").c_str());
+    rmdir((dir + "/b").c_str());
+    rmdir(root);
 
-public:
-    AhoCorasick() {
-        root = new TrieNode();
-        root->failureLink = root; // Root's failure link points to itself
+    // Buffers are written in input order whatever order inputs finish in.
+    FILE* stream = tmpfile();
+    OrderedOutput output(stream);
+    string head = "0a";
+    output.complete(2, "2");
+    output.writeIfHead(1, head);
+    assert(head == "0a");
+    output.writeIfHead(0, head);
+    output.complete(1, "1");
+    output.complete(0, "0b");
+    // Inputs may start only fewer than `window` places past the head.
+    OrderedOutput windowed(stream, 2);
+    bool admitted = windowed.admit(1, false);
+    bool admittedPastWindow = windowed.admit(2, false);
+    assert(admitted && !admittedPastWindow);
+    thread waiter([&windowed]() {
+        bool waited = windowed.admit(3, true);
+        assert(waited);
+    });
+    windowed.complete(1, "");
+    windowed.complete(0, "");
+    waiter.join();
+    rewind(stream);
+    char written[16] = {};
+    size_t readBack = fread(written, 1, sizeof(written), stream);
+    assert(readBack == 6);
+    assert(string(written) == "0a0b12");
+    fclose(stream);
+
+    cout << "--- All Grep Tests Passed! ---" << endl;
+}
+
+void testIngestion() {
+    cout << "--- Starting Ingestion Tests ---" << endl;
+
+    char root[] = "/tmp/aho_corasick_ingestXXXXXX";
+    char* made = mkdtemp(root);
+    assert(made != nullptr);
+    vector<InputFile> files;
+    vector<string> contents;
+    for (int i = 0; i < 40; ++i) {
+        string path = string(root) + "/f" + to_string(i);
+        string content(static_cast<size_t>(i) * 397 % 9000, static_cast<char>('a' + i % 26));
+        FILE* handle = fopen(path.c_str(), "w");
+        fwrite(content.data(), 1, content.size(), handle);
+        fclose(handle);
+        files.push_back({path, content.size(), 0});
+        contents.push_back(content);
     }
+    files.push_back({string(root) + "/missing", 100, 0});
+    contents.push_back("");
+    vector<size_t> order(files.size());
+    iota(order.begin(), order.end(), 0);
 
-    ~AhoCorasick() {
-        deleteTrie(root);
+    // Whole files up to the buffer size arrive loaded; the rest arrive unread.
+    for (bool useIoUring : {true, false}) {
+        IngestOptions options;
+        options.bufferSize = 4096;
+        options.queueDepth = 4;
+        options.useIoUring = useIoUring;
+        vector<int> seen(files.size(), 0);
+        mutex lock;
+        // Ingestion stays within a window of the inputs the workers have finished.
+        FILE* sink = tmpfile();
+        OrderedOutput output(sink, 4);
+        auto admit = [&output](size_t index, bool wait) { return output.admit(index, wait); };
+        ingestFiles(files, order, 3, options, admit, [&](unsigned worker, size_t index, const char* data, size_t size) {
+            assert(worker < 3);
+            bool readAhead = files[index].size > 0 && files[index].size <= options.bufferSize && index < 40;
+            assert((data != nullptr) == readAhead);
+            assert(data == nullptr || string(data, size) == contents[index]);
+            {
+                lock_guard<mutex> guard(lock);
+                ++seen[index];
+            }
+            output.complete(index, "");
+        });
+        fclose(sink);
+        assert(count(seen.begin(), seen.end(), 1) == static_cast<long>(files.size()));
     }
 
-    /**
-     * @brief Adds a pattern to the Aho-Corasick automaton.
-     * 
-     * This function adds the given pattern to the trie. It traverses the trie
-     * according to the characters in the pattern, creating new nodes if necessary.
-     * @param pattern The pattern to be added.
-     * 
-     * @note Time Complexity: O(p), where p is the length of the pattern.
-     * @note Space Complexity: O(p), in the worst case where the pattern does not
-     *       share any prefix with the existing patterns.
-     */
-    void addPattern(const string& pattern) {
-        TrieNode* currentNode = root;
-        int patternIndex = patterns.size();
-        patterns.push_back(pattern);
+    for (const InputFile& file : files) {
+        unlink(file.path.c_str());
+    }
+    rmdir(root);
 
-        for (char ch : pattern) {
-            if (currentNode->children.find(ch) == currentNode->children.end()) {
-                currentNode->children[ch] = new TrieNode();
-            }
-            currentNode = currentNode->children[ch];
+    cout << "--- All Ingestion Tests Passed! ---" << endl;
+}
+
+void testDecompression() {
+    cout << "--- Starting Decompression Tests ---" << endl;
+
+    // The ring hands slots over in order and stops the producer on cancel().
+    BufferRing ring(2, 8);
+    thread producer([&ring]() {
+        for (int i = 0; char* slot = ring.acquire(); ++i) {
+            slot[0] = static_cast<char>(i);
+            ring.publish(1);
         }
-        currentNode->patternIndices.push_back(patternIndex);
+        ring.close();
+    });
+    const char* data;
+    size_t size;
+    for (int i = 0; i < 100; ++i) {
+        bool available = ring.next(data, size);
+        assert(available && size == 1 && data[0] == static_cast<char>(i));
+        ring.release();
     }
+    ring.cancel();
+    producer.join();
 
-    /**
-     * @brief Builds the failure links and output links for the Aho-Corasick automaton.
-     * 
-     * The function uses a breadth-first search (BFS) to traverse the trie and set
-     * the failure and output links for each node.
-     * 
-     * @note Time Complexity: O(m), where m is the total number of characters in all
-     *       patterns.
-     * @note Space Complexity: O(m), mainly for storing the nodes of the Trie. The
-     *       queue used for BFS has a maximum size of the number of nodes.
-     */
-    void buildFailureLinks() {
-        queue<TrieNode*> q;
+    AhoCorasick ac({"hers", "she"});
+    string text;
+    for (int i = 0; i < 100000; ++i) {
+        text += i % 7 == 0 ? "ushers " : "others ";
+    }
+    size_t expected = 0;
+    ac.search(text, [&expected](const Match&) { ++expected; });
 
-        for (auto const& [key, val] : root->children) {
-            TrieNode* childNode = val;
-            childNode->failureLink = root;
-             childNode->outputLink = nullptr;
-            q.push(childNode);
-        }
+    auto scanBytes = [&ac](const string& input, size_t& count) {
+        char path[] = "/tmp/aho_corasick_zXXXXXX";
+        int fd = mkstemp(path);
+        ssize_t stored = write(fd, input.data(), input.size());
+        assert(stored == static_cast<ssize_t>(input.size()));
+        lseek(fd, 0, SEEK_SET);
+        count = 0;
+        bool ok = scanCompressedFd(ac, fd, [&count](const Match&) { ++count; });
+        close(fd);
+        unlink(path);
+        return ok;
+    };
+    // Feeds a pipe one piece at a time, each only once the last was read, so
+    // every piece arrives as a chunk of its own.
+    auto scanPieces = [&ac](const vector<string>& pieces, size_t& count) {
+        int pipeFds[2];
+        int piped = pipe(pipeFds);
+        assert(piped == 0);
+        thread writer([&pieces, &pipeFds]() {
+            for (const string& piece : pieces) {
+                int pending = 0;
+                while (ioctl(pipeFds[0], FIONREAD, &pending) == 0 && pending > 0) {
+                    this_thread::yield();
+                }
+                ssize_t stored = write(pipeFds[1], piece.data(), piece.size());
+                assert(stored == static_cast<ssize_t>(piece.size()));
+            }
+            close(pipeFds[1]);
+        });
+        count = 0;
+        bool ok = scanCompressedFd(ac, pipeFds[0], [&count](const Match&) { ++count; });
+        writer.join();
+        close(pipeFds[0]);
+        return ok;
+    };
 
-        while (!q.empty()) {
-            TrieNode* currentNode = q.front();
-            q.pop();
+    // Uncompressed input is passed through, however short or split.
+    size_t count;
+    bool scanned = scanBytes(text, count);
+    assert(scanned && count == expected);
+    scanned = scanPieces({"us", "h", "ers"}, count);
+    assert(scanned && count == 2);
+    scanned = scanBytes("she", count);
+    assert(scanned && count == 1);
 
-            for (auto const& [key, val] : currentNode->children) {
-                char transitionChar = key;
-                TrieNode* targetNode = val;
+#ifdef AHO_CORASICK_WITH_ZLIB
+    // Two concatenated gzip members decode back to back; a truncated one fails.
+    z_stream deflater;
+    memset(&deflater, 0, sizeof(deflater));
+    int status = deflateInit2(&deflater, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    assert(status == Z_OK);
+    string member(deflateBound(&deflater, text.size()), '\0');
+    deflater.next_in = reinterpret_cast<Bytef*>(&text[0]);
+    deflater.avail_in = static_cast<uInt>(text.size());
+    deflater.next_out = reinterpret_cast<Bytef*>(&member[0]);
+    deflater.avail_out = static_cast<uInt>(member.size());
+    status = deflate(&deflater, Z_FINISH);
+    assert(status == Z_STREAM_END);
+    member.resize(deflater.total_out);
+    deflateEnd(&deflater);
+    scanned = scanBytes(member + member, count);
+    assert(scanned && count == 2 * expected);
+    scanned = scanBytes(member.substr(0, member.size() / 2), count);
+    assert(!scanned);
+    // The magic is recognized when it is split across reads.
+    scanned = scanPieces({member.substr(0, 1), member.substr(1, 2), member.substr(3)}, count);
+    assert(scanned && count == expected);
+    // Zero padding after the last member ends the input; anything else after it is corrupt.
+    scanned = scanPieces({member, string(1000, '\0'), string(24, '\0')}, count);
+    assert(scanned && count == expected);
+    scanned = scanBytes(member + string(3, '\0') + "she", count);
+    assert(!scanned);
+#else
+    // gzip input cannot be decoded without zlib, even when its magic is split across reads.
+    scanned = scanBytes("\x1f\x8b\x08\x00", count);
+    assert(!scanned);
+    scanned = scanPieces({"\x1f", "\x8b", "\x08\x00"}, count);
+    assert(!scanned);
+#endif
 
-                TrieNode* tempFailureNode = currentNode->failureLink;
-                while (tempFailureNode != root && tempFailureNode->children.find(transitionChar) == tempFailureNode->children.end()) {
-                    tempFailureNode = tempFailureNode->failureLink;
-                }
-                if (tempFailureNode->children.find(transitionChar) != tempFailureNode->children.end()) {
-                    targetNode->failureLink = tempFailureNode->children[transitionChar];
-                } else {
-                    targetNode->failureLink = root;
-                }
+    cout << "--- All Decompression Tests Passed! ---" << endl;
+}
 
-                TrieNode* failNode = targetNode->failureLink;
-                if (!failNode->patternIndices.empty()) {
-                    targetNode->outputLink = failNode;
-                } else {
-                    targetNode->outputLink = failNode->outputLink;
-                }
+void testStaticAutomaton() {
+    cout << "--- Starting Static Automaton Tests ---" << endl;
 
-                q.push(targetNode);
-            }
+    // Built and evaluated by the compiler.
+    static constexpr auto kFilter = makeStaticAutomaton("he", "she", "his", "hers", "he");
+    static_assert(kFilter.countMatches("ushers") == 4, "he (twice), she, hers");
+    static_assert(kFilter.contains("this") && !kFilter.contains("xyz"), "");
+    static_assert(kFilter.size() == 10, "prefixes are shared");
+
+    // Same matches, in the same order, as the dynamic automaton.
+    vector<string> patterns = {"he", "she", "his", "hers", "he"};
+    AhoCorasick ac(patterns);
+    TestRandom nextRandom(7);
+    for (int round = 0; round < 200; ++round) {
+        string text;
+        for (int i = 0; i < 40; ++i) {
+            text += "hers"[nextRandom() % 4];
         }
+        vector<tuple<int, size_t, size_t>> expected;
+        ac.search(text, collectMatches(expected));
+        vector<tuple<int, size_t, size_t>> found;
+        kFilter.search(text, collectMatches(found));
+        assert(found == expected);
     }
 
-    /**
-     * @brief Searches for all patterns in the given text using the Aho-Corasick algorithm.
-     * 
-     * This function traverses the text character by character. For each character,
-     * it follows the transitions in the Aho-Corasick automaton. If it reaches a
-     * node that corresponds to the end of one or more patterns, it records the
-     * pattern index and the ending position of the match in the text.
-     * 
-     * @param text The text to search within.
-     * @return A vector of pairs. Each pair contains the index of a found pattern
-     *         and the ending position (index in the text) where the pattern ends.
-     *         The starting position of the match can be derived by subtracting
-     *         the pattern length from the ending position.
-     * 
-     * @note Time Complexity: O(n + z), where n is the length of the text, 
-     *       and z is the number of matches found.
-     * @note Space Complexity: O(m), where m is the total length of all patterns.
-     */
-    vector<pair<int, int>> search(const string& text) {
-        vector<pair<int, int>> matches;
-        TrieNode* currentNode = root;
+    cout << "--- All Static Automaton Tests Passed! ---" << endl;
+}
 
-        for (int i = 0; i < text.length(); ++i) {
-            char currentChar = text[i];
+void testCompiledAutomaton() {
+    cout << "--- Starting Compiled Automaton Tests ---" << endl;
 
-            while (currentNode != root && currentNode->children.find(currentChar) == currentNode->children.end()) {
-                currentNode = currentNode->failureLink;
+    TestRandom nextRandom(99);
+    for (int round = 0; round < 20; ++round) {
+        vector<string> patterns;
+        for (int p = 0; p < 30; ++p) {
+            string pattern;
+            for (int length = 1 + nextRandom() % 6; length > 0; --length) {
+                pattern += static_cast<char>('a' + nextRandom() % 4);
             }
+            patterns.push_back(pattern);
+        }
+        string text;
+        for (int i = 0; i < 500; ++i) {
+            text += static_cast<char>('a' + nextRandom() % 5);
+        }
+        vector<tuple<int, size_t, size_t>> expected;
+        AhoCorasick(patterns).search(text, collectMatches(expected));
 
-            if (currentNode->children.find(currentChar) != currentNode->children.end()) {
-                currentNode = currentNode->children[currentChar];
-            }
+        // Narrow and wide state indices give the same matches.
+        CompiledAutomaton<uint16_t, uint8_t> narrow(toBytePatterns(patterns));
+        CompiledAutomaton<uint32_t, uint8_t> wide(toBytePatterns(patterns));
+        assert(narrow.valid() && narrow.size() == wide.size());
+        assert(narrow.tableBytes() * 2 == wide.tableBytes());
+        vector<tuple<int, size_t, size_t>> found;
+        narrow.search(text, collectMatches(found));
+        assert(found == expected);
+        found.clear();
+        wide.search(text, collectMatches(found));
+        assert(found == expected);
+        narrow.reorderByFrequency(text.substr(0, 100));
+        found.clear();
+        narrow.search(text, collectMatches(found));
+        assert(found == expected);
 
-            TrieNode* outputNode = currentNode;
-            while (outputNode != nullptr) {
-                if (!outputNode->patternIndices.empty()) {
-                    for (int patternIndex : outputNode->patternIndices) {
-                        matches.push_back({patternIndex, i});
-                    }
-                }
-                outputNode = outputNode->outputLink;
+        // Merging equivalent states reports the same matches in the same order.
+        CompiledOptions minimizing;
+        minimizing.minimize = true;
+        CompiledAutomaton<uint16_t, uint8_t> minimal(toBytePatterns(patterns), minimizing);
+        assert(minimal.valid() && minimal.size() <= narrow.size());
+        found.clear();
+        minimal.search(text, collectMatches(found));
+        assert(found == expected);
+
+        // Token ids far apart match like the bytes they stand for.
+        vector<vector<uint32_t>> tokenPatterns;
+        for (const string& pattern : patterns) {
+            tokenPatterns.emplace_back();
+            for (char ch : pattern) {
+                tokenPatterns.back().push_back(1000000u * static_cast<uint32_t>(ch));
             }
         }
-        return matches;
+        vector<uint32_t> tokens;
+        for (char ch : text) {
+            tokens.push_back(1000000u * static_cast<uint32_t>(ch));
+        }
+        CompiledAutomaton<uint16_t, uint32_t> tokenAutomaton(tokenPatterns);
+        found.clear();
+        tokenAutomaton.search(tokens, collectMatches(found));
+        assert(found == expected);
     }
 
-    /**
-     * @brief Retrieves the pattern at the specified index.
-     * 
-     * This function returns a const reference to the pattern stored at the given
-     * index in the internal list of patterns. If the index is out of bounds, it
-     * returns a const reference to an empty string.
-     * 
-     * @param index The index of the pattern to retrieve.
-     * @return A const reference to the pattern at the specified index, or a const
-     *         reference to an empty string if the index is invalid.
-     */
-
-    const string& getPattern(int index) const {
-         if (index >= 0 && index < patterns.size()) {
-            return patterns[index];
+    // Huge-page tables, frequency ordering and interleaved scanning change
+    // nothing about the matches.
+    vector<string> patterns = {"he", "she", "his", "hers", "is", "this"};
+    CompiledOptions hugePages;
+    hugePages.hugePages = true;
+    CompiledAutomaton<uint16_t, uint8_t> tuned(toBytePatterns(patterns), hugePages);
+    assert(tuned.tableOnHugePages());
+    tuned.reorderByFrequency("this is his house; she said hers is there");
+    vector<string> texts = {"ushers", "", "this history", "he", "his hers", "shishe", "x", "hhhh", "is this", "shers"};
+    for (bool prefetch : {false, true}) {
+        vector<tuple<size_t, int, size_t, size_t>> found;
+        tuned.searchInterleaved(vector<string_view>(texts.begin(), texts.end()),
+                                [&found](size_t stream, const Match& match) {
+            found.emplace_back(stream, match.patternIndex, match.startPosition, match.endPosition);
+        }, prefetch);
+        vector<tuple<size_t, int, size_t, size_t>> expected;
+        AhoCorasick ac(patterns);
+        for (size_t stream = 0; stream < texts.size(); ++stream) {
+            ac.search(texts[stream], [&expected, stream](const Match& match) {
+                expected.emplace_back(stream, match.patternIndex, match.startPosition, match.endPosition);
+            });
         }
-        static const string empty = "";
-        return empty;
+        sort(found.begin(), found.end());
+        sort(expected.begin(), expected.end());
+        assert(found == expected);
     }
-};
 
-void runTest(const string& testName,
-             const vector<string>& patterns,
-             const string& text,
-             vector<pair<int, int>> expected_matches
-) {
-    cout << "Running test: " << testName << "..." << endl;
-    AhoCorasick ac;
-    for (const auto& p : patterns) {
-        ac.addPattern(p);
+    // Domains sharing their endings: their tails merge, matches stay per pattern.
+    vector<string> domains;
+    for (int i = 0; i < 500; ++i) {
+        string name;
+        for (int length = 4 + nextRandom() % 4; length > 0; --length) {
+            name += static_cast<char>('a' + nextRandom() % 26);
+        }
+        static const char* const kEndings[] = {".com", ".net", ".co.uk"};
+        domains.push_back(name + kEndings[nextRandom() % 3]);
     }
-    ac.buildFailureLinks();
+    domains.push_back(domains[7]);   // Duplicates are both reported
+    CompiledOptions minimizing;
+    minimizing.minimize = true;
+    CompiledAutomaton<uint32_t, uint8_t> full(toBytePatterns(domains));
+    CompiledAutomaton<uint32_t, uint8_t> merged(toBytePatterns(domains), minimizing);
+    assert(merged.size() * 2 < full.size() && merged.memoryBytes() * 2 < full.memoryBytes());
+    string page;
+    for (int i = 0; i < 2000; ++i) {
+        page += nextRandom() % 4 == 0 ? domains[nextRandom() % domains.size()] + " " : string(1, "co.m ku"[nextRandom() % 7]);
+    }
+    vector<tuple<int, size_t, size_t>> expected;
+    AhoCorasick(domains).search(page, collectMatches(expected));
+    vector<tuple<int, size_t, size_t>> found;
+    merged.search(page, collectMatches(found));
+    assert(found == expected && expected.size() > 400);
+    merged.reorderByFrequency(page.substr(0, 1000));
+    found.clear();
+    merged.search(page, collectMatches(found));
+    assert(found == expected);
+    vector<tuple<size_t, int, size_t, size_t>> interleaved;
+    merged.searchInterleaved({page.substr(0, 300), page}, [&interleaved](size_t stream, const Match& match) {
+        interleaved.emplace_back(stream, match.patternIndex, match.startPosition, match.endPosition);
+    });
+    assert(count_if(interleaved.begin(), interleaved.end(), [](const auto& match) { return get<0>(match) == 1; }) ==
+           static_cast<ptrdiff_t>(expected.size()));
 
-    vector<pair<int, int>> actual_matches = ac.search(text);
+    // Pieces of a stream, some shorter than a pattern, identify matches
+    // across their boundaries.
+    for (CompiledAutomaton<uint32_t, uint8_t>* automaton : {&full, &merged}) {
+        found.clear();
+        CompiledAutomaton<uint32_t, uint8_t>::ScanCursor cursor;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(page.data());
+        for (size_t offset = 0; offset < page.size();) {
+            size_t piece = min<size_t>(page.size() - offset, 1 + nextRandom() % 20);
+            automaton->scan(cursor, bytes + offset, piece, collectMatches(found));
+            offset += piece;
+        }
+        assert(found == expected && cursor.offset == page.size());
+    }
 
-    auto sort_key = [](const pair<int, int>& a, const pair<int, int>& b) {
-        if (a.second != b.second) {
-            return a.second < b.second;
+    // A layout profiled over a corpus survives saving and loading.
+    vector<string> corpus = {page.substr(0, 4000), page.substr(4000, 4000), "no domains here"};
+    CompiledAutomaton<uint32_t, uint8_t> profiled(toBytePatterns(domains));
+    vector<uint64_t> visits;
+    uint64_t corpusSize = 0;
+    for (const string& document : corpus) {
+        profiled.recordVisits(document, visits);
+        corpusSize += document.size();
+    }
+    assert(visits.size() == profiled.size() && accumulate(visits.begin(), visits.end(), uint64_t(0)) == corpusSize);
+    profiled.reorderByVisits(visits);
+    vector<uint64_t> after;
+    for (const string& document : corpus) {
+        profiled.recordVisits(document, after);
+    }
+    assert(is_sorted(after.begin() + 1, after.begin() + profiled.nonAcceptingStates(), greater<uint64_t>()));
+    char path[] = "/tmp/aho_corasick_layoutXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    auto readFile = [&path]() {
+        ifstream in(path, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    };
+    for (CompiledAutomaton<uint32_t, uint8_t>* saved : {&profiled, &merged}) {
+        {
+            ofstream out(path, ios::binary);
+            bool written = saved->save(out);
+            assert(written);
         }
-        return a.first < b.first;
+        string bytes = readFile();
+        for (bool huge : {false, true}) {
+            CompiledOptions loadOptions;
+            loadOptions.hugePages = huge;
+            CompiledAutomaton<uint32_t, uint8_t> loaded;
+            ifstream in(path, ios::binary);
+            bool read = loaded.load(in, loadOptions);
+            assert(read);
+            assert(loaded.size() == saved->size() && loaded.nonAcceptingStates() == saved->nonAcceptingStates());
+            found.clear();
+            loaded.search(page, collectMatches(found));
+            assert(found == expected);
+            {
+                ofstream out(path, ios::binary);
+                bool rewritten = loaded.save(out);
+                assert(rewritten);
+            }
+            assert(readFile() == bytes);
+        }
+        CompiledAutomaton<uint16_t, uint8_t> otherWidth;
+        ifstream in(path, ios::binary);
+        bool read = otherWidth.load(in);
+        assert(!read);
+        {
+            ofstream out(path, ios::binary);
+            out.write(bytes.data(), bytes.size() / 2);
+        }
+        CompiledAutomaton<uint32_t, uint8_t> truncated;
+        ifstream half(path, ios::binary);
+        read = truncated.load(half);
+        assert(!read && !truncated.valid());
+
+        // On a stream that cannot seek, a corrupt table size fails cleanly.
+        struct UnseekableBuffer : streambuf {
+            explicit UnseekableBuffer(string& data) {
+                setg(&data[0], &data[0], &data[0] + data.size());
+            }
+        };
+        uint64_t symbolCount;
+        memcpy(&symbolCount, &bytes[48], sizeof(symbolCount));
+        uint64_t hugeCount = uint64_t(1) << 40;
+        memcpy(&bytes[48 + 8 + symbolCount], &hugeCount, sizeof(hugeCount));
+        UnseekableBuffer buffer(bytes);
+        istream unseekable(&buffer);
+        CompiledAutomaton<uint32_t, uint8_t> corrupt;
+        read = corrupt.load(unseekable);
+        assert(!read && !corrupt.valid());
+    }
+    unlink(path);
+
+    // Minimized states may only list lengths of stored patterns, and a listed
+    // length longer than the text read so far is not looked up before it.
+    CompiledAutomaton<uint32_t, uint8_t> shortAndLong(toBytePatterns({"ab", "b"}), minimizing);
+    ostringstream image;
+    bool saved = shortAndLong.save(image);
+    assert(saved);
+    string bytes = image.str();
+    auto skipArray = [&bytes](size_t offset, size_t elementSize) {
+        uint64_t count;
+        memcpy(&count, &bytes[offset], sizeof(count));
+        return offset + sizeof(count) + count * elementSize;
     };
-    sort(actual_matches.begin(), actual_matches.end(), sort_key);
-    sort(expected_matches.begin(), expected_matches.end(), sort_key);
+    size_t outputs = 48; // Past the header: symbols, table, output links and output offsets
+    for (size_t elementSize : {sizeof(uint8_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t)}) {
+        outputs = skipArray(outputs, elementSize);
+    }
+    uint64_t outputCount;
+    memcpy(&outputCount, &bytes[outputs], sizeof(outputCount));
+    assert(outputCount > 0);
+    for (int length : {100000, 2}) {
+        string corruptBytes = bytes;
+        for (uint64_t k = 0; k < outputCount; ++k) {
+            memcpy(&corruptBytes[outputs + sizeof(outputCount) + k * sizeof(int)], &length, sizeof(length));
+        }
+        istringstream in(corruptBytes);
+        CompiledAutomaton<uint32_t, uint8_t> corruptLengths;
+        bool loaded = corruptLengths.load(in);
+        assert(loaded == (length == 2));
+        size_t count = 0;
+        corruptLengths.search("b", [&count](const Match&) { ++count; });
+        assert(count == 0);
+    }
 
-    assert(actual_matches == expected_matches);
+    // Accepting states (he, she, his, hers) are numbered after all others.
+    CompiledAutomaton<uint8_t, uint8_t> small(toBytePatterns({"he", "she", "his", "hers"}));
+    assert(small.size() == 10 && small.nonAcceptingStates() == 6);
 
-    cout << "Test '" << testName << "' PASSED." << endl << endl;
+    // A dictionary too big for the state type fails to build.
+    vector<string> many;
+    for (int i = 0; i < 300; ++i) {
+        many.push_back(to_string(i * 7919));
+    }
+    CompiledAutomaton<uint8_t, uint8_t> tooSmall(toBytePatterns(many));
+    assert(!tooSmall.valid());
+    size_t count = 0;
+    tooSmall.search("7919", [&count](const Match&) { ++count; });
+    assert(count == 0);
+
+    cout << "--- All Compiled Automaton Tests Passed! ---" << endl;
 }
 
-void testAhoCorasick() {
-    cout << "--- Starting AhoCorasick Tests ---" << endl;
+void testTokenAutomaton() {
+    cout << "--- Starting Token Automaton Tests ---" << endl;
 
-    // Test Case 1: Simple Non-Overlapping
-    runTest("Simple Non-Overlapping",
-            {"a", "b", "c"},
-            "abc",
-            {{0, 0}, {1, 1}, {2, 2}}
-    );
+    TestRandom nextRandom(4242);
+    // Few distinct tokens make phrases overlap; many make the root table wide
+    // and some children lists long enough for binary search.
+    for (uint32_t vocabulary : {4u, 50000u}) {
+        vector<vector<uint32_t>> phrases;
+        for (int p = 0; p < 400; ++p) {
+            vector<uint32_t> phrase;
+            for (int length = 1 + nextRandom() % 4; length > 0; --length) {
+                phrase.push_back(nextRandom() % 3 == 0 ? nextRandom() % 4 : nextRandom() * 7 % vocabulary);
+            }
+            phrases.push_back(phrase);
+        }
+        phrases.push_back(phrases[17]); // A duplicate phrase reports both indices
+        vector<uint32_t> tokens;
+        for (int i = 0; i < 20000; ++i) {
+            tokens.push_back(nextRandom() % 2 == 0 ? nextRandom() % 4 : nextRandom() * 7 % (vocabulary + 10));
+        }
 
-    // Test Case 2: Standard Overlap Example
-    runTest("Standard Overlap",
-            {"he", "she", "his", "hers"},
-            "ushers",
-            {{0, 3}, {1, 3}, {3, 5}}
-    );
+        vector<tuple<int, size_t, size_t>> expected;
+        CompiledAutomaton<uint32_t, uint32_t>(phrases).search(tokens, collectMatches(expected));
+        vector<tuple<int, size_t, size_t>> found;
+        TokenAutomaton(phrases).search(tokens, collectMatches(found));
+        assert(!expected.empty());
+        assert(found == expected);
+    }
 
-    // Test Case 3: Prefix/Suffix/Overlap Mix
-    runTest("Prefix/Suffix/Overlap Mix",
-            {"a", "ab", "bab", "bc", "bca", "c", "caa"},
-            "abccab",
-            {{0, 0}, {1, 1}, {3, 2}, {5, 2}, {5, 3}, {0, 4}, {1, 5}}
-    );
+    // Ids up to 0xFFFFFFFF, e.g. hashes, keep the root table small and still match.
+    vector<vector<uint32_t>> hashed = {{0xFFFFFFFFu, 1}, {5, 6}, {4000000000u}, {1, 0xFFFFFFFFu}, {0xFFFFFFFFu}};
+    TokenAutomaton wide(hashed);
+    assert(wide.memoryBytes() < 4096);
+    vector<uint32_t> tokens = {5, 0xFFFFFFFFu, 1, 0xFFFFFFFFu, 4000000000u, 5, 6, 0xFFFFFFFEu};
+    vector<tuple<int, size_t, size_t>> expected;
+    CompiledAutomaton<uint32_t, uint32_t>(hashed).search(tokens, collectMatches(expected));
+    vector<tuple<int, size_t, size_t>> found;
+    wide.search(tokens, collectMatches(found));
+    assert(expected.size() == 6 && found == expected);
 
-    // Test Case 4: Multiple Occurrences of Same Pattern
-     runTest("Multiple Occurrences",
-            {"aba"},
-            "ababaxaba",
-            {{0, 2}, {0, 4}, {0, 8}}
-    );
+    cout << "--- All Token Automaton Tests Passed! ---" << endl;
+}
 
-     // Test Case 5: No Matches
-    runTest("No Matches",
-            {"xyz", "123"},
-            "abcde",
-            {}
-    );
+void testHybridAutomaton() {
+    cout << "--- Starting Hybrid Automaton Tests ---" << endl;
 
-     // Test Case 6: Empty Text
-    runTest("Empty Text",
-            {"a", "b"},
-            "",
-            {}
-    );
+    TestRandom nextRandom(31337);
+    for (CaseFolding mode : {CaseFolding::None, CaseFolding::Ascii}) {
+        AhoCorasickOptions options;
+        options.caseFolding = mode;
+        AhoCorasick ac(options);
+        static const uint8_t kAnchors[] = {AnchorNone, AnchorNone, AnchorWordStart, AnchorWord, AnchorLineEnd};
+        for (int p = 0; p < 300; ++p) {
+            string pattern;
+            for (int length = 1 + nextRandom() % (p % 10 == 0 ? 40 : 6); length > 0; --length) {
+                pattern += "abAB c\n\xe9"[nextRandom() % 9];
+            }
+            ac.addPattern(pattern, kAnchors[nextRandom() % 5], p * 10);
+        }
+        ac.buildFailureLinks();
+        string text;
+        for (int i = 0; i < 5000; ++i) {
+            text += "abAB c\n\xe9"[nextRandom() % 9];
+        }
+        // Sorted: the streaming scan reports end-anchored matches at the very end last.
+        vector<tuple<int, size_t, size_t, uint64_t>> expected;
+        ac.search(text, collectMatches(expected));
+        sort(expected.begin(), expected.end());
 
-    // Test Case 7: Empty Patterns
-    runTest("Empty Patterns",
-            {},
-            "abc",
-            {}
-    );
+        for (unsigned denseDepth : {0u, 1u, 3u, 100u}) {
+            HybridAutomaton hybrid(ac, denseDepth);
+            assert(hybrid.valid());
+            vector<tuple<int, size_t, size_t, uint64_t>> found;
+            hybrid.search(text, collectMatches(found));
+            sort(found.begin(), found.end());
+            assert(found == expected);
+        }
+    }
 
-    // Test Case 8: Longer Text and More Overlaps (mississippi example)
-    runTest("Complex Overlaps (Mississippi)",
-            {"i", "is", "ppi", "sip", "mississippi"},
-            "mississippi",
-            {
-                {0, 1},
-                {1, 2},
-                {0, 4},
-                {1, 5},
-                {0, 7},
-                {3, 8},
-                {0, 10},
-                {2, 10},
-                {4, 10}
-            }
-    );
+    // Long single-child tails stay sparse: far fewer transition bytes than full rows.
+    AhoCorasick urls;
+    for (int i = 0; i < 200; ++i) {
+        urls.addPattern("https://example.com/path/" + to_string(i * 7919) + "/index.html");
+    }
+    urls.buildFailureLinks();
+    HybridAutomaton hybrid(urls, 2);
+    assert(hybrid.transitionBytes() * 20 < (hybrid.size() + hybrid.segmentPositions()) * 256 * sizeof(uint32_t));
 
-    // Test Case 9: Patterns ending at the same place
-    runTest("Patterns Ending Together",
-            {"a", "ba", "cba"},
-            "dcba",
-            { {0, 3}, {1, 3}, {2, 3} }
-    );
+    // Long distinct hashes: the tails fold into segments, leaving few real states.
+    AhoCorasick hashes;
+    vector<string> hashPatterns;
+    for (int i = 0; i < 100; ++i) {
+        string hash;
+        for (int j = 0; j < 40; ++j) {
+            hash += "0123456789abcdef"[nextRandom() % 16];
+        }
+        hashPatterns.push_back(hash);
+        hashes.addPattern(hash, i % 7 == 0 ? AnchorWord : AnchorNone);
+    }
+    hashes.addPattern(hashPatterns[3].substr(0, 20));   // Reports inside another chain
+    hashes.addPattern(hashPatterns[5].substr(30));      // Suffix: an output link mid-chain
+    hashes.buildFailureLinks();
+    HybridAutomaton compact(hashes, 1);
+    assert(compact.segmentPositions() > 100 * 30);
+    assert(compact.size() * 10 < compact.segmentPositions());
+    string hashText;
+    for (int i = 0; i < 400; ++i) {
+        // Whole hashes, prefixes cut off at random points, and noise.
+        const string& hash = hashPatterns[nextRandom() % hashPatterns.size()];
+        int kind = nextRandom() % 3;
+        hashText += kind == 0 ? hash : kind == 1 ? hash.substr(0, nextRandom() % 40) : string(1, "0a ."[nextRandom() % 4]);
+        if (nextRandom() % 2) {
+            hashText += ' ';
+        }
+    }
+    vector<tuple<int, size_t, size_t, uint64_t>> expected;
+    hashes.search(hashText, collectMatches(expected));
+    sort(expected.begin(), expected.end());
+    assert(expected.size() > 100);
+    for (unsigned denseDepth : {0u, 2u}) {
+        vector<tuple<int, size_t, size_t, uint64_t>> found;
+        HybridAutomaton(hashes, denseDepth).search(hashText, collectMatches(found));
+        sort(found.begin(), found.end());
+        assert(found == expected);
+    }
 
+    AhoCorasickOptions unicode;
+    unicode.caseFolding = CaseFolding::Unicode;
+    assert(!HybridAutomaton(AhoCorasick({"x"}, false, unicode)).valid());
 
-    cout << "--- All AhoCorasick Tests Passed! ---" << endl;
+    cout << "--- All Hybrid Automaton Tests Passed! ---" << endl;
 }
 
 void runAhoCorasickSample() {
@@ -324,16 +7178,12 @@ void runAhoCorasickSample() {
     }
     cout << endl << "Matches found:" << endl;
 
-    vector<pair<int, int>> matches = ac.search(text);
+    vector<Match> matches = ac.searchMatches(text);
 
     for (const auto& match : matches) {
-        int patternIndex = match.first;
-        int endPosition = match.second;
-        string patternStr = ac.getPattern(patternIndex);
-        int startPosition = endPosition - patternStr.length() + 1;
-
-        cout << "  Pattern '" << patternStr << "' (Index " << patternIndex << ") found ending at index " << endPosition
-                  << " (Span: [" << startPosition << ", " << endPosition << "])" << endl;
+        cout << "  Pattern '" << ac.getPattern(match.patternIndex) << "' (Index " << match.patternIndex
+                  << ") found ending at index " << match.endPosition
+                  << " (Span: [" << match.startPosition << ", " << match.endPosition << "])" << endl;
     }
      if (matches.empty()) {
         cout << "  No matches found." << endl;
@@ -341,8 +7191,65 @@ void runAhoCorasickSample() {
 
 }
 
-int main() {
+// aho_corasick scan PATTERN_FILE [FILE...]: prints path:offset:pattern per match.
+int runScanCommand(int argc, char** argv) {
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << " scan PATTERN_FILE [FILE...]" << endl;
+        return 2;
+    }
+    vector<string> patterns;
+    if (!readPatternFile(argv[2], patterns)) {
+        cerr << argv[0] << ": cannot read pattern file " << argv[2] << endl;
+        return 2;
+    }
+    AhoCorasick ac(patterns);
+
+    vector<string> paths(argv + 3, argv + argc);
+    if (paths.empty()) {
+        paths.push_back("-");
+    }
+    int status = 1;
+    for (const string& path : paths) {
+        bool ok = scanFile(ac, path, [&](const Match& match) {
+            cout << path << ':' << match.startPosition << ':' << ac.getPattern(match.patternIndex) << '\n';
+            status = status == 2 ? 2 : 0;
+        });
+        if (!ok) {
+            cerr << argv[0] << ": " << path << ": cannot read" << endl;
+            status = 2;
+        }
+    }
+    return status;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && string(argv[1]) == "scan") {
+        return runScanCommand(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "grep") {
+        return runGrepCommand(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "bench") {
+        return runBenchCommand(argc, argv);
+    }
+
     testAhoCorasick();
+    testAutomatonHolder();
+    testParallelBuild();
+    testAnchoredMatching();
+    testPayloads();
+    testDeduplication();
+    testMemoryAccounting();
+    testPatternStorage();
+    testMatchSpans();
+    testChunkedScan();
+    testGrep();
+    testIngestion();
+    testDecompression();
+    testStaticAutomaton();
+    testCompiledAutomaton();
+    testTokenAutomaton();
+    testHybridAutomaton();
     runAhoCorasickSample();
     return 0;
 }
\ No newline at end of file